@@ -60,6 +60,8 @@
   #include "PIT.h"
   #include "FTM.h"
   #include "UART.h"
+  #include "Flash.h"
+  #include "analog.h"
   #include "OS.h"
 
 
@@ -97,7 +99,7 @@
     (tIsrFunc)&OS_SysTickISR,          /* 0x0F  0x0000003C   -   ivINT_SysTick                  unused by PE */
     (tIsrFunc)&Cpu_Interrupt,          /* 0x10  0x00000040   -   ivINT_DMA0_DMA16               unused by PE */
     (tIsrFunc)&Cpu_Interrupt,          /* 0x11  0x00000044   -   ivINT_DMA1_DMA17               unused by PE */
-    (tIsrFunc)&Cpu_Interrupt,          /* 0x12  0x00000048   -   ivINT_DMA2_DMA18               unused by PE */
+    (tIsrFunc)&Analog_ISR,             /* 0x12  0x00000048   -   ivINT_DMA2_DMA18               unused by PE */
     (tIsrFunc)&Cpu_Interrupt,          /* 0x13  0x0000004C   -   ivINT_DMA3_DMA19               unused by PE */
     (tIsrFunc)&Cpu_Interrupt,          /* 0x14  0x00000050   -   ivINT_DMA4_DMA20               unused by PE */
     (tIsrFunc)&Cpu_Interrupt,          /* 0x15  0x00000054   -   ivINT_DMA5_DMA21               unused by PE */
@@ -113,7 +115,7 @@
     (tIsrFunc)&Cpu_Interrupt,          /* 0x1F  0x0000007C   -   ivINT_DMA15_DMA31              unused by PE */
     (tIsrFunc)&Cpu_Interrupt,          /* 0x20  0x00000080   -   ivINT_DMA_Error                unused by PE */
     (tIsrFunc)&Cpu_Interrupt,          /* 0x21  0x00000084   -   ivINT_MCM                      unused by PE */
-    (tIsrFunc)&Cpu_Interrupt,          /* 0x22  0x00000088   -   ivINT_FTFE                     unused by PE */
+    (tIsrFunc)&Flash_ISR,              /* 0x22  0x00000088   -   ivINT_FTFE                     unused by PE */
     (tIsrFunc)&Cpu_Interrupt,          /* 0x23  0x0000008C   -   ivINT_Read_Collision           unused by PE */
     (tIsrFunc)&Cpu_Interrupt,          /* 0x24  0x00000090   -   ivINT_LVD_LVW                  unused by PE */
     (tIsrFunc)&Cpu_Interrupt,          /* 0x25  0x00000094   -   ivINT_LLW                      unused by PE */
@@ -161,7 +163,7 @@
     (tIsrFunc)&Cpu_Interrupt,          /* 0x4F  0x0000013C   -   ivINT_FTM1                     unused by PE */
     (tIsrFunc)&Cpu_Interrupt,          /* 0x50  0x00000140   -   ivINT_FTM2                     unused by PE */
     (tIsrFunc)&Cpu_Interrupt,          /* 0x51  0x00000144   -   ivINT_CMT                      unused by PE */
-    (tIsrFunc)&Cpu_Interrupt,          /* 0x52  0x00000148   -   ivINT_RTC                      unused by PE */
+    (tIsrFunc)&RTC_AlarmISR,           /* 0x52  0x00000148   -   ivINT_RTC                      unused by PE */
     (tIsrFunc)&RTC_ISR,                /* 0x53  0x0000014C   -   ivINT_RTC_Seconds              unused by PE */
     (tIsrFunc)&PIT_ISR,                /* 0x54  0x00000150   -   ivINT_PIT0                     unused by PE */
     (tIsrFunc)&Cpu_Interrupt,          /* 0x55  0x00000154   -   ivINT_PIT1                     unused by PE */
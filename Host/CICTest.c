@@ -0,0 +1,136 @@
+/*! @file
+ *
+ *  @brief Test of the cascaded integrator-comb decimation filter.
+ *
+ *  This checks that every allowed order and decimation ratio passes a DC input through unchanged at both ends
+ *  of the sample range, including a full-scale step from one end to the other, which relies on the integrators
+ *  wrapping around. Settings the filter cannot hold in 32 bits must be rejected.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-29
+ */
+/*!
+**  @addtogroup CICTest_module CICTest module documentation
+**  @{
+*/
+// header files used
+#include "CIC.h"
+#include "PE_Types.h"
+#include <stdio.h>
+
+//outputs given after a change of input before the filter is expected to have settled
+#define SETTLE_OUTPUTS (CIC_MAX_ORDER + 1)
+
+//checks a condition and reports it if it fails
+#define CHECK(condition) Check((condition), #condition, __LINE__)
+
+static uint16_t Failures;
+
+/*************************function prototypes***************************/
+static void Check(const bool passed, const char* const condition, const int line);
+
+static bool SettlesTo(TCIC* const cic, const int16_t level);
+
+static void TestDC(void);
+
+static void TestSettings(void);
+/***********************************************************************/
+
+/*! @brief Runs each test and reports the number of failures.
+ *
+ *  @return int - 0 if every check passed.
+ */
+int main(void)
+{
+  TestDC();
+  TestSettings();
+
+  printf("%u failure(s)\n", Failures);
+  return Failures ? 1 : 0;
+}
+
+/*! @brief Counts and reports a failed check.
+ *
+ *  @param passed is TRUE if the check passed.
+ *  @param condition is the text of the condition that was checked.
+ *  @param line is the line of the check.
+ */
+static void Check(const bool passed, const char* const condition, const int line)
+{
+  if (passed)
+    return;
+
+  printf("CICTest.c:%d: failed: %s\n", line, condition);
+  Failures++;
+}
+
+/*! @brief Puts a constant level into a filter until it has settled, then checks a few more outputs.
+ *
+ *  @param cic is the filter.
+ *  @param level is the input.
+ *  @return bool - TRUE if the outputs after settling all equal the input, and there is one every 2^ratioShift samples.
+ */
+static bool SettlesTo(TCIC* const cic, const int16_t level)
+{
+  uint16_t outputs = 0, samples = 0;
+  int16_t output;
+  bool passed = TRUE;
+
+  while (outputs < 2 * SETTLE_OUTPUTS)
+    {
+      samples++;
+      if (!CIC_Put(cic, level, &output))
+	continue;
+
+      if (samples != (1u << cic->ratioShift))
+	passed = FALSE;
+      samples = 0;
+
+      outputs++;
+      if (outputs > SETTLE_OUTPUTS && output != level)
+	{
+	  printf("order %u, ratio 2^%u: %d for %d\n", cic->order, cic->ratioShift, output, level);
+	  passed = FALSE;
+	}
+    }
+
+  return passed;
+}
+
+/*! @brief DC at both ends of the range, and 0, passes through every allowed setting unchanged.
+ */
+static void TestDC(void)
+{
+  TCIC cic;
+
+  for (uint8_t order = 1; order <= CIC_MAX_ORDER; order++)
+    for (uint8_t ratioShift = 0; ratioShift <= CIC_MAX_RATIO_SHIFT && order * ratioShift <= CIC_MAX_GAIN_SHIFT; ratioShift++)
+      {
+	CHECK(CIC_Init(&cic, order, ratioShift));
+	CHECK(SettlesTo(&cic, 32767));
+	CHECK(SettlesTo(&cic, -32768));
+	CHECK(SettlesTo(&cic, 32767));
+	CHECK(SettlesTo(&cic, 0));
+
+	CHECK(CIC_Init(&cic, order, ratioShift));
+	CHECK(SettlesTo(&cic, -32768));
+      }
+}
+
+/*! @brief Settings out of range, or with a gain too large for 32 bits, are rejected.
+ */
+static void TestSettings(void)
+{
+  TCIC cic;
+
+  CHECK(!CIC_Init(&cic, 0, 1));
+  CHECK(!CIC_Init(&cic, CIC_MAX_ORDER + 1, 1));
+  CHECK(!CIC_Init(&cic, 1, CIC_MAX_RATIO_SHIFT + 1));
+  CHECK(!CIC_Init(&cic, 3, 6));
+  CHECK(CIC_Init(&cic, 3, 5));
+  CHECK(CIC_Init(&cic, 2, 7));
+}
+
+/*!
+** @}
+*/
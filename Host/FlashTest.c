@@ -0,0 +1,359 @@
+/*! @file
+ *
+ *  @brief Smoke test of the Flash module against the simulated FTFE.
+ *
+ *  This builds flash.c with FLASH_SIM defined and checks erasing, programming, the ACCERR and FPVIOL errors,
+ *  Flash_AllocateVar, the read-modify-write path through ModifyPhrase, Program Section, the verify stage
+ *  and the swap system. A clock thread stands in for the FTFE,
+ *  moving the simulated time forward while a command is in progress and calling Flash_ISR when it completes.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-29
+ */
+/*!
+**  @addtogroup FlashTest_module FlashTest module documentation
+**  @{
+*/
+// header files used
+#include "Flash.h"
+#include "Cpu.h"
+#include "PE_Types.h"
+#include "OS.h"
+#include <stdio.h>
+#include <sched.h>
+
+//simulated time that passes each time the clock thread runs, in microseconds
+#define CLOCK_STEP 100
+
+//checks a condition and reports it if it fails
+#define CHECK(condition) Check((condition), #condition, __LINE__)
+
+static uint16_t Failures;
+
+/*************************function prototypes***************************/
+static void Check(const bool passed, const char* const condition, const int line);
+
+static void* ClockThread(void* arg);
+
+static bool SectorIs(const uint32_t address, const uint8_t value);
+
+static void TestErase(void);
+
+static void TestProgram(void);
+
+static void TestErrors(void);
+
+static void TestAllocateVar(void);
+
+static void TestModifyPhrase(void);
+
+static void TestWriteSection(void);
+
+static void TestVerify(void);
+
+static void TestSwap(void);
+/***********************************************************************/
+
+/*! @brief Runs each test and reports the number of failures.
+ *
+ *  @return int - 0 if every check passed.
+ */
+int main(void)
+{
+  pthread_t clock;
+
+  FlashSim_Init();
+  OS_Init(0, FALSE);
+  if (!Flash_Init())
+    {
+      printf("Flash_Init failed\n");
+      return 1;
+    }
+  pthread_create(&clock, NULL, ClockThread, NULL);
+
+  TestErase();
+  TestProgram();
+  TestErrors();
+  TestAllocateVar();
+  TestModifyPhrase();
+  TestWriteSection();
+  TestVerify();
+  TestSwap();
+
+  printf("%u failure(s)\n", Failures);
+  return Failures ? 1 : 0;
+}
+
+/*! @brief Counts and reports a failed check.
+ *
+ *  @param passed is TRUE if the check passed.
+ *  @param condition is the text of the condition that was checked.
+ *  @param line is the line of the check.
+ */
+static void Check(const bool passed, const char* const condition, const int line)
+{
+  if (passed)
+    return;
+
+  printf("FlashTest.c:%d: failed: %s\n", line, condition);
+  Failures++;
+}
+
+/*! @brief Moves the simulated time forward while a command is in progress.
+ *
+ *  The simulated Flash ISR runs with "interrupts disabled", so it never runs inside a critical section of the Flash module.
+ *  @param arg Unused.
+ *  @return void* - Never returns.
+ */
+static void* ClockThread(void* arg)
+{
+  for (;;)
+    {
+      OS_DisableInterrupts();
+      if (FlashSim_Busy())
+	FlashSim_Advance(CLOCK_STEP);
+      OS_EnableInterrupts();
+      sched_yield();
+    }
+
+  return NULL;
+}
+
+/*! @brief Checks every byte of a sector.
+ *
+ *  @param address The address of the start of the sector.
+ *  @param value The value every byte should have.
+ *  @return bool - TRUE if every byte has the value.
+ */
+static bool SectorIs(const uint32_t address, const uint8_t value)
+{
+  for (uint32_t i = 0; i < FLASH_SECTOR_SIZE; i++)
+    if (_FB(address + i) != value)
+      return FALSE;
+
+  return TRUE;
+}
+
+/*! @brief Erasing sets every bit of the sector, counts the erase and times it.
+ */
+static void TestErase(void)
+{
+  TFlashStats stats;
+
+  CHECK(Flash_WritePhrase(FLASH_BENCH_SECTOR, 0));
+  CHECK(!SectorIs(FLASH_BENCH_SECTOR, 0xFF));
+
+  CHECK(Flash_EraseSector(FLASH_BENCH_SECTOR));
+  CHECK(SectorIs(FLASH_BENCH_SECTOR, 0xFF));
+  CHECK(FlashSim_EraseCount(FLASH_BENCH_SECTOR) == 1);
+
+  CHECK(Flash_GetStats(FLASH_STATS_ERASE, &stats));
+  CHECK(stats.count == 1 && stats.min > 0);
+}
+
+/*! @brief Programming can only clear bits, so a second program without an erase leaves the AND of the two.
+ */
+static void TestProgram(void)
+{
+  CHECK(Flash_EraseSector(FLASH_BENCH_SECTOR));
+
+  CHECK(Flash_WritePhrase(FLASH_BENCH_SECTOR, 0x0123456789ABCDEFLLU));
+  CHECK(_FP(FLASH_BENCH_SECTOR) == 0x0123456789ABCDEFLLU);
+
+  CHECK(Flash_WritePhrase(FLASH_BENCH_SECTOR, 0xFFFF0000FFFF0000LLU));
+  CHECK(_FP(FLASH_BENCH_SECTOR) == 0x0123000089AB0000LLU);
+
+  //the rest of the sector is untouched
+  CHECK(_FP(FLASH_BENCH_SECTOR + 8) == 0xFFFFFFFFFFFFFFFFLLU);
+}
+
+/*! @brief Commands the FTFE rejects fail with ACCERR or FPVIOL and leave the Flash alone.
+ */
+static void TestErrors(void)
+{
+  uint32_t erases = FlashSim_EraseCount(FLASH_BENCH_SECTOR);
+
+  //past the end of the Flash
+  CHECK(!Flash_EraseSector(FLASH_SIM_SIZE));
+  CHECK(FTFE_FSTAT & FTFE_FSTAT_ACCERR_MASK);
+
+  CHECK(Flash_WritePhrase(FLASH_BENCH_SECTOR + 8, 0));
+  FlashSim_Protect(FLASH_BENCH_SECTOR, TRUE);
+
+  CHECK(!Flash_EraseSector(FLASH_BENCH_SECTOR));
+  CHECK(FTFE_FSTAT & FTFE_FSTAT_FPVIOL_MASK);
+  CHECK(!Flash_WritePhrase(FLASH_BENCH_SECTOR + 16, 0));
+  CHECK(FTFE_FSTAT & FTFE_FSTAT_FPVIOL_MASK);
+  CHECK(_FP(FLASH_BENCH_SECTOR + 8) == 0 && _FP(FLASH_BENCH_SECTOR + 16) == 0xFFFFFFFFFFFFFFFFLLU);
+  CHECK(FlashSim_EraseCount(FLASH_BENCH_SECTOR) == erases);
+
+  FlashSim_Protect(FLASH_BENCH_SECTOR, FALSE);
+  CHECK(Flash_EraseSector(FLASH_BENCH_SECTOR));
+  CHECK(!(FTFE_FSTAT & (FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK)));
+}
+
+/*! @brief Variables are aligned to their size, do not overlap, and run out after FLASH_DATA_END.
+ */
+static void TestAllocateVar(void)
+{
+  volatile uint8_t* byte0;
+  volatile uint8_t* byte1;
+  volatile uint8_t* byte2;
+  volatile uint16_t* halfWord;
+  volatile uint32_t* word;
+
+  CHECK(Flash_AllocateVar((volatile void**)&byte0, sizeof(*byte0)));
+  CHECK((uint32_t)byte0 == FLASH_DATA_START);
+
+  CHECK(Flash_AllocateVar((volatile void**)&halfWord, sizeof(*halfWord)));
+  CHECK((uint32_t)halfWord == FLASH_DATA_START + 2);
+
+  CHECK(Flash_AllocateVar((volatile void**)&word, sizeof(*word)));
+  CHECK((uint32_t)word == FLASH_DATA_START + 4);
+
+  //the byte left between the first byte and the half-word
+  CHECK(Flash_AllocateVar((volatile void**)&byte1, sizeof(*byte1)));
+  CHECK((uint32_t)byte1 == FLASH_DATA_START + 1);
+
+  CHECK(!Flash_AllocateVar((volatile void**)&byte2, sizeof(*byte2)));
+  CHECK(!Flash_AllocateVar((volatile void**)&byte2, 3));
+}
+
+/*! @brief Each write erases the data sector and programs the phrase back with only the written bytes changed.
+ */
+static void TestModifyPhrase(void)
+{
+  uint32_t erases = FlashSim_EraseCount(FLASH_DATA_START);
+  TFlashStats stats;
+
+  CHECK(Flash_Write32((volatile uint32_t*)(FLASH_DATA_START + 4), 0x12345678));
+  CHECK(Flash_Write16((volatile uint16_t*)(FLASH_DATA_START + 2), 0xABCD));
+  CHECK(Flash_Write8((volatile uint8_t*)(FLASH_DATA_START + 0), 0x5A));
+  CHECK(Flash_Write8((volatile uint8_t*)(FLASH_DATA_START + 1), 0xA5));
+
+  CHECK(_FW(FLASH_DATA_START + 4) == 0x12345678);
+  CHECK(_FH(FLASH_DATA_START + 2) == 0xABCD);
+  CHECK(_FB(FLASH_DATA_START + 0) == 0x5A);
+  CHECK(_FB(FLASH_DATA_START + 1) == 0xA5);
+  CHECK(FlashSim_EraseCount(FLASH_DATA_START) == erases + 4);
+
+  //clearing and then setting bits both work, as every write starts from an erased phrase
+  CHECK(Flash_Write32((volatile uint32_t*)(FLASH_DATA_START + 4), 0xFFFFFFFF));
+  CHECK(_FW(FLASH_DATA_START + 4) == 0xFFFFFFFF);
+  CHECK(_FH(FLASH_DATA_START + 2) == 0xABCD);
+
+  //misaligned and out of range writes are refused
+  CHECK(!Flash_Write32((volatile uint32_t*)(FLASH_DATA_START + 2), 0));
+  CHECK(!Flash_Write16((volatile uint16_t*)(FLASH_DATA_START + 1), 0));
+  CHECK(!Flash_Write8((volatile uint8_t*)(FLASH_DATA_END + 1), 0));
+
+  CHECK(Flash_GetStats(FLASH_STATS_MODIFY, &stats));
+  CHECK(stats.count == 5);
+}
+
+/*! @brief A block that crosses a sector boundary is programmed from the FlexRAM with one Program Section command per sector.
+ */
+static void TestWriteSection(void)
+{
+  //32 bytes either side of the boundary between the first two log sectors
+  const uint32_t address = FLASH_LOG_START + FLASH_SECTOR_SIZE - 32;
+  uint8_t data[64];
+  TFlashStats before, after;
+
+  for (uint8_t i = 0; i < sizeof(data); i++)
+    data[i] = 0xA0 + i;
+
+  CHECK(Flash_EraseSector(FLASH_LOG_START));
+  CHECK(Flash_EraseSector(FLASH_LOG_START + FLASH_SECTOR_SIZE));
+  CHECK(Flash_GetStats(FLASH_STATS_SECTION, &before));
+
+  CHECK(Flash_WriteSection(address, data, sizeof(data)));
+  for (uint8_t i = 0; i < sizeof(data); i++)
+    CHECK(_FB(address + i) == data[i]);
+
+  //the Flash either side of the block is untouched
+  CHECK(_FP(address - 8) == 0xFFFFFFFFFFFFFFFFLLU);
+  CHECK(_FP(address + sizeof(data)) == 0xFFFFFFFFFFFFFFFFLLU);
+
+  CHECK(Flash_GetStats(FLASH_STATS_SECTION, &after));
+  CHECK(after.count == before.count + 2);
+
+  //the address and length have to be whole 128-bit units
+  CHECK(!Flash_WriteSection(address + 8, data, sizeof(data)));
+  CHECK(!Flash_WriteSection(address, data, 8));
+  CHECK(!Flash_WriteSection(FLASH_WRITABLE_START - FLASH_SECTOR_SIZE, data, sizeof(data)));
+}
+
+/*! @brief Flash_Verify passes on what was programmed and fails on anything else, and the verify stage checks erases and writes.
+ */
+static void TestVerify(void)
+{
+  const uint32_t address = FLASH_LOG_START + FLASH_SECTOR_SIZE - 32;
+  uint8_t data[64];
+  TFlashStats before, after;
+
+  for (uint8_t i = 0; i < sizeof(data); i++)
+    data[i] = 0xA0 + i;
+
+  CHECK(Flash_GetStats(FLASH_STATS_VERIFY, &before));
+  CHECK(Flash_Verify(address, data, sizeof(data)));
+  CHECK(Flash_GetStats(FLASH_STATS_VERIFY, &after));
+  CHECK(after.count > before.count);
+
+  //one wrong byte in the middle fails the check, as does a misaligned range
+  data[33] ^= 0x01;
+  CHECK(!Flash_Verify(address, data, sizeof(data)));
+  data[33] ^= 0x01;
+  CHECK(!Flash_Verify(address + 2, data, sizeof(data)));
+
+  Flash_SetVerify(TRUE);
+  CHECK(Flash_IsVerifying());
+
+  //Read 1s Section passes on a good erase and fails on a worn out sector
+  CHECK(Flash_EraseSector(FLASH_LOG_START));
+  FlashSim_SetEndurance(FlashSim_EraseCount(FLASH_LOG_START));
+  CHECK(!Flash_EraseSector(FLASH_LOG_START));
+  FlashSim_SetEndurance(0);
+
+  //programming over a programmed phrase leaves the AND of the two, which the check finds
+  CHECK(Flash_EraseSector(FLASH_LOG_START));
+  CHECK(Flash_WritePhrase(FLASH_LOG_START, 0x0123456789ABCDEFLLU));
+  CHECK(!Flash_WritePhrase(FLASH_LOG_START, 0xFFFF0000FFFF0000LLU));
+  CHECK(!Flash_WriteSection(FLASH_LOG_START, data, sizeof(data)));
+  CHECK(Flash_WriteSection(FLASH_LOG_START + sizeof(data), data, sizeof(data)));
+
+  Flash_SetVerify(FALSE);
+}
+
+/*! @brief The swap system steps through its states in order, and the halves swap at the next reset once it is complete.
+ */
+static void TestSwap(void)
+{
+  TFlashSwapMode mode;
+
+  CHECK(Flash_Swap(FLASH_SWAP_REPORT, &mode) && mode == FLASH_SWAP_UNINITIALIZED);
+
+  //an update cannot start before the system is initialized
+  CHECK(!Flash_Swap(FLASH_SWAP_SET_UPDATE, &mode));
+
+  CHECK(Flash_Swap(FLASH_SWAP_INITIALIZE, &mode) && mode == FLASH_SWAP_READY);
+  CHECK(Flash_Swap(FLASH_SWAP_SET_UPDATE, &mode) && mode == FLASH_SWAP_UPDATE);
+
+  //the indicator in the upper half has to be erased before the update can complete
+  CHECK(!Flash_Swap(FLASH_SWAP_SET_COMPLETE, &mode));
+  CHECK(Flash_EraseSector(FLASH_UPDATE_START + FLASH_SWAP_INDICATOR));
+  CHECK(Flash_Swap(FLASH_SWAP_REPORT, &mode) && mode == FLASH_SWAP_UPDATE_ERASED);
+
+  CHECK(Flash_EraseSector(FLASH_UPDATE_START));
+  CHECK(Flash_WritePhrase(FLASH_UPDATE_START, 0x0123456789ABCDEFLLU));
+  CHECK(Flash_Swap(FLASH_SWAP_SET_COMPLETE, &mode) && mode == FLASH_SWAP_COMPLETE);
+  CHECK(_FP(0) != 0x0123456789ABCDEFLLU);
+
+  FlashSim_Reset();
+  CHECK(_FP(0) == 0x0123456789ABCDEFLLU);
+  CHECK(Flash_Swap(FLASH_SWAP_REPORT, &mode) && mode == FLASH_SWAP_READY);
+}
+
+/*!
+** @}
+*/
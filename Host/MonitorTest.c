@@ -0,0 +1,205 @@
+/*! @file
+ *
+ *  @brief Test of the analog channel monitors.
+ *
+ *  This checks that noise inside the deadband is not reported, that the window limits report each crossing once
+ *  and only come back to normal past the hysteresis, and that the rate check only fires on a fast change.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-29
+ */
+/*!
+**  @addtogroup MonitorTest_module MonitorTest module documentation
+**  @{
+*/
+// header files used
+#include "Monitor.h"
+#include "PE_Types.h"
+#include <stdio.h>
+
+//number of noisy samples put through the deadband
+#define NOISE_SAMPLES 1000
+//largest noise, in LSB either side of the level
+#define NOISE_AMPLITUDE 3
+
+//checks a condition and reports it if it fails
+#define CHECK(condition) Check((condition), #condition, __LINE__)
+
+static uint16_t Failures;
+
+//state of the noise generator, so that every run sees the same noise
+static uint32_t Seed = 1;
+
+/*************************function prototypes***************************/
+static void Check(const bool passed, const char* const condition, const int line);
+
+static int16_t Noise(void);
+
+static void TestSettings(void);
+
+static void TestDeadband(void);
+
+static void TestHysteresis(void);
+
+static void TestRate(void);
+/***********************************************************************/
+
+/*! @brief Runs each test and reports the number of failures.
+ *
+ *  @return int - 0 if every check passed.
+ */
+int main(void)
+{
+  TestSettings();
+  TestDeadband();
+  TestHysteresis();
+  TestRate();
+
+  printf("%u failure(s)\n", Failures);
+  return Failures ? 1 : 0;
+}
+
+/*! @brief Counts and reports a failed check.
+ *
+ *  @param passed is TRUE if the check passed.
+ *  @param condition is the text of the condition that was checked.
+ *  @param line is the line of the check.
+ */
+static void Check(const bool passed, const char* const condition, const int line)
+{
+  if (passed)
+    return;
+
+  printf("MonitorTest.c:%d: failed: %s\n", line, condition);
+  Failures++;
+}
+
+/*! @brief Makes pseudo-random noise.
+ *
+ *  @return int16_t - A value from -NOISE_AMPLITUDE to NOISE_AMPLITUDE.
+ */
+static int16_t Noise(void)
+{
+  Seed = Seed * 1103515245 + 12345;
+  return (int16_t)((Seed >> 16) % (2 * NOISE_AMPLITUDE + 1)) - NOISE_AMPLITUDE;
+}
+
+/*! @brief Settings are checked, and a disabled channel reports nothing.
+ */
+static void TestSettings(void)
+{
+  Monitor_Init();
+
+  CHECK(Monitor_Get(0, MONITOR_LOW) == INT16_MIN);
+  CHECK(Monitor_Get(0, MONITOR_HIGH) == INT16_MAX);
+  CHECK(Monitor_Check(0, 1234) == 0);
+
+  CHECK(!Monitor_Set(ANALOG_NB_INPUTS, MONITOR_ENABLE, 1));
+  CHECK(!Monitor_Set(0, MONITOR_NB_SETTINGS, 1));
+  CHECK(!Monitor_Set(0, MONITOR_ENABLE, 2));
+  CHECK(!Monitor_Set(0, MONITOR_DEADBAND, -1));
+  CHECK(!Monitor_Set(0, MONITOR_HYSTERESIS, -1));
+  CHECK(!Monitor_Set(0, MONITOR_RATE, -1));
+
+  CHECK(Monitor_Set(0, MONITOR_DEADBAND, 10));
+  CHECK(Monitor_Get(0, MONITOR_DEADBAND) == 10);
+}
+
+/*! @brief Noise of a few LSB inside a deadband of 10 is reported once, when the channel is enabled, and never again.
+ */
+static void TestDeadband(void)
+{
+  uint16_t changes = 0;
+  uint8_t events = 0;
+
+  Monitor_Init();
+  CHECK(Monitor_Set(1, MONITOR_DEADBAND, 10));
+  CHECK(Monitor_Set(1, MONITOR_ENABLE, 1));
+
+  for (uint16_t i = 0; i < NOISE_SAMPLES; i++)
+    {
+      uint8_t found = Monitor_Check(1, 1000 + Noise());
+
+      if (found & MONITOR_EVENT_CHANGE)
+	changes++;
+      events |= found;
+    }
+
+  CHECK(changes == 1);
+  CHECK(events == MONITOR_EVENT_CHANGE);
+
+  //a move past the deadband is reported, and the deadband then follows the new value
+  CHECK(Monitor_Check(1, 1020) == MONITOR_EVENT_CHANGE);
+  CHECK(Monitor_Check(1, 1012) == 0);
+  CHECK(Monitor_Check(1, 1009) == MONITOR_EVENT_CHANGE);
+
+  //enabling the channel again reports the value straight away
+  CHECK(Monitor_Set(1, MONITOR_ENABLE, 0));
+  CHECK(Monitor_Set(1, MONITOR_ENABLE, 1));
+  CHECK(Monitor_Check(1, 1009) == MONITOR_EVENT_CHANGE);
+}
+
+/*! @brief Each limit is reported once when it is crossed, and the value is only normal again once back past the hysteresis.
+ */
+static void TestHysteresis(void)
+{
+  const uint8_t inWindow = 0;
+
+  Monitor_Init();
+  CHECK(Monitor_Set(2, MONITOR_DEADBAND, INT16_MAX));
+  CHECK(Monitor_Set(2, MONITOR_LOW, -100));
+  CHECK(Monitor_Set(2, MONITOR_HIGH, 100));
+  CHECK(Monitor_Set(2, MONITOR_HYSTERESIS, 10));
+  CHECK(Monitor_Set(2, MONITOR_ENABLE, 1));
+
+  CHECK(Monitor_Check(2, 0) == MONITOR_EVENT_CHANGE);
+  CHECK(Monitor_Check(2, 100) == inWindow);
+  CHECK(Monitor_Check(2, 101) == MONITOR_EVENT_HIGH);
+
+  //noise around the limit is not reported again
+  for (uint16_t i = 0; i < NOISE_SAMPLES; i++)
+    CHECK(Monitor_Check(2, 100 + Noise()) == 0);
+
+  CHECK(Monitor_Check(2, 91) == 0);
+  CHECK(Monitor_Check(2, 90) == MONITOR_EVENT_NORMAL);
+  CHECK(Monitor_Check(2, 95) == 0);
+
+  CHECK(Monitor_Check(2, -101) == MONITOR_EVENT_LOW);
+  for (uint16_t i = 0; i < NOISE_SAMPLES; i++)
+    CHECK(Monitor_Check(2, -100 + Noise()) == 0);
+  CHECK(Monitor_Check(2, -90) == MONITOR_EVENT_NORMAL);
+
+  //a jump straight from one side of the window to the other is reported as the new side
+  CHECK(Monitor_Check(2, 200) == MONITOR_EVENT_HIGH);
+  CHECK(Monitor_Check(2, -200) == MONITOR_EVENT_LOW);
+  CHECK(Monitor_Check(2, 0) == MONITOR_EVENT_NORMAL);
+}
+
+/*! @brief A change between checks larger than the rate is reported, and noise is not.
+ */
+static void TestRate(void)
+{
+  Monitor_Init();
+  CHECK(Monitor_Set(3, MONITOR_DEADBAND, INT16_MAX));
+  CHECK(Monitor_Set(3, MONITOR_RATE, 50));
+  CHECK(Monitor_Set(3, MONITOR_ENABLE, 1));
+
+  //the first value has nothing to be compared with
+  CHECK(Monitor_Check(3, 30000) == MONITOR_EVENT_CHANGE);
+
+  for (uint16_t i = 0; i < NOISE_SAMPLES; i++)
+    CHECK(Monitor_Check(3, 30000 + Noise()) == 0);
+
+  CHECK(Monitor_Check(3, 30000) == 0);
+  CHECK(Monitor_Check(3, 30050) == 0);
+  CHECK(Monitor_Check(3, 30101) == MONITOR_EVENT_RATE);
+  CHECK(Monitor_Check(3, 30101) == 0);
+
+  //the full range is a change the rate can measure, even though it is more than an int16_t holds, and it is past the deadband too
+  CHECK(Monitor_Check(3, INT16_MIN) & MONITOR_EVENT_RATE);
+  CHECK(Monitor_Check(3, INT16_MAX) & MONITOR_EVENT_RATE);
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,222 @@
+/*! @file
+ *
+ *  @brief Stand-in for the RTOS when modules are built and tested on a host PC.
+ *
+ *  This contains the POSIX thread implementation of the OS interface used by the modules.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-29
+ */
+/*!
+**  @addtogroup HostOS_module Host OS module documentation
+**  @{
+*/
+// header files used
+#include "OS.h"
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+//a thread and its argument, passed to the POSIX thread that runs it
+typedef struct
+{
+  void (*thread)(void*);  /*!< The thread's code. */
+  void* pData;            /*!< The argument passed to the thread. */
+} TThreadStart;
+
+static OS_ECB Events[OS_MAX_EVENTS];
+static uint8_t NbEvents;
+static TThreadStart Threads[OS_MAX_USER_THREADS];
+static uint8_t NbThreads;
+//the value of the monotonic clock, in milliseconds, when the system clock was 0
+static uint64_t TimeOffset;
+
+//taken while "interrupts are disabled" and while a simulated ISR runs
+static pthread_mutex_t InterruptLock = PTHREAD_MUTEX_INITIALIZER;
+//guards the tables of events and threads
+static pthread_mutex_t TableLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*************************function prototypes***************************/
+static uint64_t Milliseconds(void);
+
+static void* RunThread(void* start);
+/***********************************************************************/
+
+
+void OS_Init(const uint32_t cpuCoreClk, const bool toggleLED)
+{
+  TimeOffset = Milliseconds();
+}
+
+
+void OS_ISREnter(void)
+{
+}
+
+
+void OS_ISRExit(void)
+{
+}
+
+
+OS_ECB* OS_SemaphoreCreate(const uint32_t value)
+{
+  OS_ECB* event = NULL;
+
+  pthread_mutex_lock(&TableLock);
+  if (NbEvents < OS_MAX_EVENTS)
+    {
+      event = &Events[NbEvents++];
+      event->count = value;
+      pthread_mutex_init(&event->mutex, NULL);
+      pthread_cond_init(&event->signal, NULL);
+    }
+  pthread_mutex_unlock(&TableLock);
+
+  return event;
+}
+
+
+OS_ERROR OS_SemaphoreSignal(OS_ECB* const pEvent)
+{
+  OS_ERROR error = OS_NO_ERROR;
+
+  pthread_mutex_lock(&pEvent->mutex);
+  if (pEvent->count == UINT32_MAX)
+    error = OS_SEMAPHORE_OVERFLOW;
+  else
+    {
+      pEvent->count++;
+      pthread_cond_signal(&pEvent->signal);
+    }
+  pthread_mutex_unlock(&pEvent->mutex);
+
+  return error;
+}
+
+
+OS_ERROR OS_SemaphoreWait(OS_ECB* const pEvent, const uint32_t timeout)
+{
+  struct timespec deadline;
+  OS_ERROR error = OS_NO_ERROR;
+
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeout / 1000;
+  deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+  pthread_mutex_lock(&pEvent->mutex);
+  while (pEvent->count == 0 && error == OS_NO_ERROR)
+    if (timeout == 0)
+      pthread_cond_wait(&pEvent->signal, &pEvent->mutex);
+    else if (pthread_cond_timedwait(&pEvent->signal, &pEvent->mutex, &deadline) == ETIMEDOUT)
+      error = OS_TIMEOUT;
+  if (pEvent->count)
+    {
+      pEvent->count--;
+      error = OS_NO_ERROR;
+    }
+  pthread_mutex_unlock(&pEvent->mutex);
+
+  return error;
+}
+
+
+void OS_Start(void)
+{
+  for (;;)
+    pause();
+}
+
+
+OS_ERROR OS_ThreadCreate(void (*thread)(void* pd), void* pData, void* pStack, const uint8_t priority)
+{
+  pthread_t handle;
+  TThreadStart* start = NULL;
+
+  pthread_mutex_lock(&TableLock);
+  if (NbThreads < OS_MAX_USER_THREADS)
+    start = &Threads[NbThreads++];
+  pthread_mutex_unlock(&TableLock);
+
+  if (!start)
+    return OS_NO_MORE_TCBS;
+
+  start->thread = thread;
+  start->pData = pData;
+  if (pthread_create(&handle, NULL, RunThread, start))
+    return OS_NO_MORE_TCBS;
+  pthread_detach(handle);
+
+  return OS_NO_ERROR;
+}
+
+
+OS_ERROR OS_ThreadDelete(uint8_t priority)
+{
+  if (priority != OS_PRIORITY_SELF)
+    return OS_THREAD_DELETE_ERROR;
+
+  pthread_exit(NULL);
+}
+
+
+void OS_TimeDelay(const uint32_t ticks)
+{
+  usleep(ticks * 1000);
+}
+
+
+uint32_t OS_TimeGet(void)
+{
+  return (uint32_t)(Milliseconds() - TimeOffset);
+}
+
+
+void OS_TimeSet(const uint32_t ticks)
+{
+  TimeOffset = Milliseconds() - ticks;
+}
+
+
+void OS_DisableInterrupts(void)
+{
+  pthread_mutex_lock(&InterruptLock);
+}
+
+
+void OS_EnableInterrupts(void)
+{
+  pthread_mutex_unlock(&InterruptLock);
+}
+
+/*! @brief Reads the monotonic clock.
+ *
+ *  @return uint64_t - The time in milliseconds.
+ */
+static uint64_t Milliseconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/*! @brief Runs an OS thread in a POSIX thread.
+ *
+ *  @param start is the thread and its argument.
+ *  @return void* - Never returns, as OS threads are infinite loops.
+ */
+static void* RunThread(void* start)
+{
+  (*((TThreadStart*)start)->thread)(((TThreadStart*)start)->pData);
+  return NULL;
+}
+
+/*!
+** @}
+*/
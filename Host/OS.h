@@ -0,0 +1,143 @@
+/*! @file
+ *
+ *  @brief Stand-in for the RTOS when modules are built and tested on a host PC.
+ *
+ *  This has the same interface as the OS.h in the Library folder, implemented with POSIX threads.
+ *  Each OS thread is a POSIX thread, semaphores are a count guarded by a mutex and a condition variable,
+ *  and disabling interrupts takes a global lock that simulated ISRs also take, so an ISR never runs inside a critical section.
+ *  Thread priorities are ignored.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-29
+ */
+/*!
+**  @addtogroup HostOS_module Host OS module documentation
+**  @{
+*/
+#ifndef OS_H
+#define OS_H
+
+// Standard types
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define OS_MAX_USER_THREADS       31
+#define OS_LOWEST_PRIORITY        31
+#define OS_MAX_EVENTS             32
+#define OS_PRIORITY_SELF          255
+
+// The host threads have their own stacks, so this only keeps the thread code unchanged
+#define OS_THREAD_STACK(x, y) static uint32_t x[y]
+
+typedef enum
+{
+  OS_NO_ERROR,
+  OS_TIMEOUT,
+  OS_PRIORITY_EXISTS,
+  OS_PRIORITY_INVALID,
+  OS_NO_MORE_TCBS,
+  OS_THREAD_DELETE_ERROR,
+  OS_THREAD_DELETE_IDLE,
+  OS_THREAD_DELETE_ISR,
+  OS_SEMAPHORE_OVERFLOW
+} OS_ERROR;
+
+typedef struct ecb
+{
+  uint32_t count;          /*!< The count of the semaphore. */
+  pthread_mutex_t mutex;   /*!< Guards the count. */
+  pthread_cond_t signal;   /*!< Signalled when the count goes up. */
+} OS_ECB;
+
+/*! @brief Sets up the OS before first use.
+ *
+ *  @param cpuCoreClk is not used on the host.
+ *  @param toggleLED is not used on the host.
+ */
+void OS_Init(const uint32_t cpuCoreClk, const bool toggleLED);
+
+/*! @brief Notifies the OS that an ISR is being processed. Nothing is needed on the host.
+ */
+void OS_ISREnter(void);
+
+/*! @brief Notifies the OS that an ISR has completed. Nothing is needed on the host.
+ */
+void OS_ISRExit(void);
+
+/*! @brief Creates and initializes a semaphore.
+ *
+ *  @param value is the initial value of the semaphore.
+ *  @return OS_ECB* - The semaphore, or NULL if there are no more.
+ */
+OS_ECB* OS_SemaphoreCreate(const uint32_t value);
+
+/*! @brief Signals a semaphore.
+ *
+ *  @param pEvent is the semaphore.
+ *  @return OS_ERROR - OS_NO_ERROR, or OS_SEMAPHORE_OVERFLOW if the count overflowed.
+ */
+OS_ERROR OS_SemaphoreSignal(OS_ECB* const pEvent);
+
+/*! @brief Waits on a semaphore.
+ *
+ *  @param pEvent is the semaphore.
+ *  @param timeout is the number of milliseconds to wait, or 0 to wait forever.
+ *  @return OS_ERROR - OS_NO_ERROR, or OS_TIMEOUT if the semaphore was not signalled in time.
+ */
+OS_ERROR OS_SemaphoreWait(OS_ECB* const pEvent, const uint32_t timeout);
+
+/*! @brief Starts the OS multithreading. The threads already run on the host, so this never returns.
+ */
+void OS_Start(void);
+
+/*! @brief Creates a thread.
+ *
+ *  @param thread is a pointer to the thread's code.
+ *  @param pData is passed to the thread.
+ *  @param pStack is not used on the host.
+ *  @param priority is not used on the host.
+ *  @return OS_ERROR - OS_NO_ERROR, or OS_NO_MORE_TCBS if the thread could not be created.
+ */
+OS_ERROR OS_ThreadCreate(void (*thread)(void* pd), void* pData, void* pStack, const uint8_t priority);
+
+/*! @brief Deletes the calling thread.
+ *
+ *  @param priority must be OS_PRIORITY_SELF on the host.
+ *  @return OS_ERROR - OS_THREAD_DELETE_ERROR if another thread was given.
+ */
+OS_ERROR OS_ThreadDelete(uint8_t priority);
+
+/*! @brief Delays the calling thread.
+ *
+ *  @param ticks is the number of milliseconds to delay.
+ */
+void OS_TimeDelay(const uint32_t ticks);
+
+/*! @brief Gets the system clock.
+ *
+ *  @return uint32_t - The number of milliseconds since OS_Init or OS_TimeSet.
+ */
+uint32_t OS_TimeGet(void);
+
+/*! @brief Sets the system clock.
+ *
+ *  @param ticks is the new value of the system clock in milliseconds.
+ */
+void OS_TimeSet(const uint32_t ticks);
+
+/*! @brief Takes the lock that stands in for disabling interrupts.
+ *
+ *  As on the tower, this does not nest.
+ */
+void OS_DisableInterrupts(void);
+
+/*! @brief Releases the lock that stands in for disabling interrupts.
+ */
+void OS_EnableInterrupts(void);
+
+#endif
+
+/*!
+** @}
+*/
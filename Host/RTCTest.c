@@ -0,0 +1,197 @@
+/*! @file
+ *
+ *  @brief Test of the RTC calendar conversions and of setting the date.
+ *
+ *  This builds RTC.c with its registers replaced by variables, checks RTC_EpochToDateTime and
+ *  RTC_DateTimeToEpoch against the host C library's gmtime across the whole range of the seconds counter,
+ *  and checks that RTC_SetDate keeps the time of day and the prescaler.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-29
+ */
+/*!
+**  @addtogroup RTCTest_module RTCTest module documentation
+**  @{
+*/
+// The ISRs are ordinary functions on the host
+#define interrupt
+
+// header files used
+#include "MK70F12.h"
+#include "Cpu.h"
+#include "PE_Types.h"
+#include "OS.h"
+#include <stdio.h>
+#include <time.h>
+
+// The registers used by the RTC module are variables on the host
+#undef RTC_BASE_PTR
+#define RTC_BASE_PTR (&HostRTC)
+#undef SIM_BASE_PTR
+#define SIM_BASE_PTR (&HostSIM)
+#undef NVIC_BASE_PTR
+#define NVIC_BASE_PTR (&HostNVIC)
+
+static volatile struct RTC_MemMap HostRTC;
+static volatile struct SIM_MemMap HostSIM;
+static volatile struct NVIC_MemMap HostNVIC;
+
+#include "RTC.c"
+
+//seconds between the times checked against gmtime, chosen so that every time of day is eventually hit
+#define SWEEP_STEP 86399
+
+//checks a condition and reports it if it fails
+#define CHECK(condition) Check((condition), #condition, __LINE__)
+
+static uint16_t Failures;
+
+/*************************function prototypes***************************/
+static void Check(const bool passed, const char* const condition, const int line);
+
+static bool MatchesGmtime(const uint32_t seconds);
+
+static void TestConversions(void);
+
+static void TestInvalidDates(void);
+
+static void TestSetDate(void);
+/***********************************************************************/
+
+/*! @brief Runs each test and reports the number of failures.
+ *
+ *  @return int - 0 if every check passed.
+ */
+int main(void)
+{
+  OS_Init(0, FALSE);
+  AlarmMutex = OS_SemaphoreCreate(1);
+
+  TestConversions();
+  TestInvalidDates();
+  TestSetDate();
+
+  printf("%u failure(s)\n", Failures);
+  return Failures ? 1 : 0;
+}
+
+/*! @brief Counts and reports a failed check.
+ *
+ *  @param passed is TRUE if the check passed.
+ *  @param condition is the text of the condition that was checked.
+ *  @param line is the line of the check.
+ */
+static void Check(const bool passed, const char* const condition, const int line)
+{
+  if (passed)
+    return;
+
+  printf("RTCTest.c:%d: failed: %s\n", line, condition);
+  Failures++;
+}
+
+/*! @brief Converts a time both ways and compares the date and time with gmtime.
+ *
+ *  @param seconds The seconds since the epoch.
+ *  @return bool - TRUE if the date and time match gmtime and convert back to the same seconds.
+ */
+static bool MatchesGmtime(const uint32_t seconds)
+{
+  time_t time = (time_t)seconds;
+  struct tm expected;
+  TRTCDateTime dateTime;
+  uint32_t back;
+
+  if (!gmtime_r(&time, &expected))
+    return FALSE;
+
+  RTC_EpochToDateTime(seconds, &dateTime);
+
+  if (dateTime.year != expected.tm_year + 1900 || dateTime.month != expected.tm_mon + 1 || dateTime.day != expected.tm_mday ||
+      dateTime.hours != expected.tm_hour || dateTime.minutes != expected.tm_min || dateTime.seconds != expected.tm_sec)
+    {
+      printf("%lu: %04u-%02u-%02u %02u:%02u:%02u\n", (unsigned long)seconds, dateTime.year, dateTime.month, dateTime.day,
+	     dateTime.hours, dateTime.minutes, dateTime.seconds);
+      return FALSE;
+    }
+
+  return RTC_DateTimeToEpoch(&dateTime, &back) && back == seconds;
+}
+
+/*! @brief Both conversions agree with gmtime from 1970 to the last second the counter can hold.
+ */
+static void TestConversions(void)
+{
+  uint32_t mismatches = 0;
+
+  for (uint64_t seconds = 0; seconds <= 0xFFFFFFFF; seconds += SWEEP_STEP)
+    if (!MatchesGmtime((uint32_t)seconds))
+      mismatches++;
+  CHECK(mismatches == 0);
+
+  //the ends of the range, and the leap days where the century rules apply
+  CHECK(MatchesGmtime(0));
+  CHECK(MatchesGmtime(0xFFFFFFFF));
+  CHECK(MatchesGmtime(951782400)); //2000-02-29
+  CHECK(MatchesGmtime(951868799)); //2000-02-29 23:59:59
+  CHECK(MatchesGmtime(4107542400)); //2100-03-01
+  CHECK(MatchesGmtime(4107542399)); //2100-02-28 23:59:59
+}
+
+/*! @brief Dates that do not exist, or that the counter cannot hold, are rejected.
+ */
+static void TestInvalidDates(void)
+{
+  TRTCDateTime dateTime = {2100, 2, 29, 0, 0, 0};
+  uint32_t seconds;
+
+  CHECK(!RTC_DateTimeToEpoch(&dateTime, &seconds));
+  dateTime.year = 2000;
+  CHECK(RTC_DateTimeToEpoch(&dateTime, &seconds) && seconds == 951782400);
+  dateTime.year = 2001;
+  CHECK(!RTC_DateTimeToEpoch(&dateTime, &seconds));
+
+  dateTime = (TRTCDateTime){2018, 4, 31, 0, 0, 0};
+  CHECK(!RTC_DateTimeToEpoch(&dateTime, &seconds));
+  dateTime = (TRTCDateTime){2018, 13, 1, 0, 0, 0};
+  CHECK(!RTC_DateTimeToEpoch(&dateTime, &seconds));
+  dateTime = (TRTCDateTime){2018, 1, 0, 0, 0, 0};
+  CHECK(!RTC_DateTimeToEpoch(&dateTime, &seconds));
+  dateTime = (TRTCDateTime){1969, 12, 31, 23, 59, 59};
+  CHECK(!RTC_DateTimeToEpoch(&dateTime, &seconds));
+
+  //the counter runs out at 2106-02-07 06:28:15
+  dateTime = (TRTCDateTime){2106, 2, 7, 6, 28, 15};
+  CHECK(RTC_DateTimeToEpoch(&dateTime, &seconds) && seconds == 0xFFFFFFFF);
+  dateTime.seconds = 16;
+  CHECK(!RTC_DateTimeToEpoch(&dateTime, &seconds));
+}
+
+/*! @brief Setting the date keeps the time of day and the fraction of the second, and a bad date changes nothing.
+ */
+static void TestSetDate(void)
+{
+  TRTCDateTime dateTime;
+
+  //2018-10-29 13:45:27 and a bit
+  HostRTC.TSR = 1540820727;
+  HostRTC.TPR = 0x1234;
+  HostRTC.SR = RTC_SR_TCE_MASK;
+
+  CHECK(RTC_SetDate(2024, 2, 29));
+  RTC_EpochToDateTime(HostRTC.TSR, &dateTime);
+  CHECK(dateTime.year == 2024 && dateTime.month == 2 && dateTime.day == 29);
+  CHECK(dateTime.hours == 13 && dateTime.minutes == 45 && dateTime.seconds == 27);
+  CHECK(HostRTC.TPR == 0x1234);
+  CHECK(HostRTC.SR & RTC_SR_TCE_MASK);
+
+  CHECK(!RTC_SetDate(2023, 2, 29));
+  CHECK(!RTC_SetDate(2106, 2, 8));
+  CHECK(HostRTC.TSR == 1709214327);
+  CHECK(HostRTC.TPR == 0x1234);
+  CHECK(HostRTC.SR & RTC_SR_TCE_MASK);
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,80 @@
+/*! @file
+ *
+ *  @brief Cascaded integrator-comb decimation filter.
+ *
+ *  This contains the functions for oversampling half-word-sized data, averaging a number of samples into each
+ *  output with a cascaded integrator-comb filter in fixed point.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-27
+ */
+/*!
+**  @addtogroup CIC_module CIC module documentation
+**  @{
+*/
+
+// New types
+#include "types.h"
+#include "CIC.h"
+#include "PE_Types.h"
+
+
+bool CIC_Init(TCIC* const cic, const uint8_t order, const uint8_t ratioShift)
+{
+  if (order == 0 || order > CIC_MAX_ORDER || ratioShift > CIC_MAX_RATIO_SHIFT || order * ratioShift > CIC_MAX_GAIN_SHIFT)
+    return FALSE;
+
+  for (uint8_t i = 0; i < CIC_MAX_ORDER; i++)
+    {
+      cic->integrators[i] = 0;
+      cic->combs[i] = 0;
+    }
+
+  cic->order = order;
+  cic->ratioShift = ratioShift;
+  cic->count = 0;
+
+  return TRUE;
+}
+
+
+bool CIC_Put(TCIC* const cic, const int16_t sample, int16_t* const output)
+{
+  //unsigned, so the integrators wrap around instead of overflowing, and the combs take the wrap back out
+  uint32_t x = (uint32_t)(int32_t)sample;
+  uint8_t gainShift;
+
+  for (uint8_t i = 0; i < cic->order; i++)
+    {
+      cic->integrators[i] += x;
+      x = cic->integrators[i];
+    }
+
+  cic->count++;
+  if (cic->count < (1 << cic->ratioShift))
+    return FALSE;
+
+  cic->count = 0;
+
+  //the combs run at the output rate, each the difference from the last output
+  for (uint8_t i = 0; i < cic->order; i++)
+    {
+      uint32_t y = x - cic->combs[i];
+
+      cic->combs[i] = x;
+      x = y;
+    }
+
+  //the gain is ratio^order, taken out with rounding
+  gainShift = cic->order * cic->ratioShift;
+  if (gainShift)
+    *output = (int16_t)(((int32_t)x + (1 << (gainShift - 1))) >> gainShift);
+  else
+    *output = (int16_t)(int32_t)x;
+
+  return TRUE;
+}
+
+/*!
+** @}
+*/
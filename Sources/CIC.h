@@ -0,0 +1,63 @@
+/*! @file
+ *
+ *  @brief Cascaded integrator-comb decimation filter.
+ *
+ *  This contains the functions for oversampling half-word-sized data, averaging a number of samples into each
+ *  output with a cascaded integrator-comb filter in fixed point.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-27
+ */
+/*!
+**  @addtogroup CIC_module CIC module documentation
+**  @{
+*/
+
+#ifndef CIC_H
+#define CIC_H
+
+// New types
+#include "types.h"
+
+// Highest order of the filter
+#define CIC_MAX_ORDER 3
+
+// Largest decimation ratio as a power of 2
+#define CIC_MAX_RATIO_SHIFT 7
+
+// Largest gain of the filter as a power of 2, order * log2(ratio), so the 16-bit samples fit in 32-bit registers
+#define CIC_MAX_GAIN_SHIFT 16
+
+typedef struct
+{
+  uint32_t integrators[CIC_MAX_ORDER];  /*!< The integrator stages, which wrap around as the filter needs them to. */
+  uint32_t combs[CIC_MAX_ORDER];        /*!< The input of each comb stage at the last output. */
+  uint8_t order;                        /*!< The number of integrator and comb stages. */
+  uint8_t ratioShift;                   /*!< The decimation ratio as a power of 2. */
+  uint8_t count;                        /*!< The number of samples put since the last output. */
+} TCIC;
+
+/*! @brief Sets up a filter and clears its state.
+ *
+ *  @param cic is the filter.
+ *  @param order is the number of stages, from 1 to CIC_MAX_ORDER.
+ *  @param ratioShift is the number of samples in each output as a power of 2, up to CIC_MAX_RATIO_SHIFT and so that order * ratioShift is at most CIC_MAX_GAIN_SHIFT.
+ *  @return bool - TRUE if the filter was set up.
+ */
+bool CIC_Init(TCIC* const cic, const uint8_t order, const uint8_t ratioShift);
+
+/*! @brief Puts a sample into a filter.
+ *
+ *  Every 2^ratioShift samples the filter gives an output, scaled back to the range of the samples and rounded.
+ *  @param cic is the filter.
+ *  @param sample is the sample.
+ *  @param output points to where the output will be stored.
+ *  @return bool - TRUE if there is an output.
+ */
+bool CIC_Put(TCIC* const cic, const int16_t sample, int16_t* const output);
+
+#endif
+
+/*!
+** @}
+*/
@@ -0,0 +1,45 @@
+/*! @file
+ *
+ *  @brief Routines for calculating cyclic redundancy checks.
+ *
+ *  This contains the functions for calculating the CRC-32 (IEEE 802.3) of blocks of data.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-21
+ */
+/*!
+**  @addtogroup CRC_module CRC module documentation
+**  @{
+*/
+// header files used
+#include "CRC.h"
+
+//CRC-32 of each 4-bit value, for the reflected polynomial 0xEDB88320
+static const uint32_t NibbleTable[16] =
+{
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+  0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+  0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+
+uint32_t CRC_Calculate(const uint32_t crc, const volatile void* const data, const uint32_t length)
+{
+  const volatile uint8_t* bytes = (const volatile uint8_t*)data;
+  uint32_t result = ~crc;
+
+  //processes each byte one nibble at a time, low nibble first
+  for (uint32_t i = 0; i < length; i++)
+    {
+      result ^= bytes[i];
+      result = (result >> 4) ^ NibbleTable[result & 0x0F];
+      result = (result >> 4) ^ NibbleTable[result & 0x0F];
+    }
+
+  return ~result;
+}
+
+/*!
+** @}
+*/
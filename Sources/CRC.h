@@ -0,0 +1,33 @@
+/*! @file
+ *
+ *  @brief Routines for calculating cyclic redundancy checks.
+ *
+ *  This contains the functions for calculating the CRC-32 (IEEE 802.3) of blocks of data.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-21
+ */
+/*!
+**  @addtogroup CRC_module CRC module documentation
+**  @{
+*/
+#ifndef CRC_H
+#define CRC_H
+
+// new types
+#include "types.h"
+
+/*! @brief Calculates the CRC-32 of a block of data.
+ *
+ *  @param crc The CRC of the data preceding this block, or 0 to start a new calculation.
+ *  @param data The block of data.
+ *  @param length The number of bytes in the block.
+ *  @return uint32_t - The CRC of all the data so far.
+ */
+uint32_t CRC_Calculate(const uint32_t crc, const volatile void* const data, const uint32_t length);
+
+#endif
+
+/*!
+** @}
+*/
@@ -0,0 +1,236 @@
+/*! @file
+ *
+ *  @brief Routines for storing the tower configuration in Flash.
+ *
+ *  This contains the functions for saving and restoring a configuration record.
+ *  The record is kept in two alternating sectors so that a power failure during a save
+ *  always leaves one complete, CRC-protected copy behind.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-21
+ */
+/*!
+**  @addtogroup Config_module Config module documentation
+**  @{
+*/
+// header files used
+#include "Config.h"
+#include "Flash.h"
+#include "CRC.h"
+#include "PE_Types.h"
+#include "OS.h"
+
+//identifies a configuration record header
+#define CONFIG_MAGIC 0x43464731LU
+//offsets within a sector
+#define CONFIG_HEADER_OFFSET  0x00
+#define CONFIG_CHECK_OFFSET   0x08
+#define CONFIG_INVALID_OFFSET 0x10
+#define CONFIG_DATA_OFFSET    0x18
+//times a save erases and writes the target sector before giving up, as a failed check is often a one-off
+#define CONFIG_SAVE_ATTEMPTS 2
+
+/*!
+ * A sector holds a header phrase, a check phrase, an invalidation phrase and then the record.
+ * The header is programmed last when saving, and the invalidation phrase is cleared once a newer copy exists.
+ */
+typedef union
+{
+  uint64_t phrase;
+  struct
+  {
+    uint32_t magic;    /*!< CONFIG_MAGIC once the copy is complete. */
+    uint32_t sequence; /*!< Incremented with every save, the newest copy has the highest. */
+  } header;
+  struct
+  {
+    uint32_t crc;      /*!< CRC-32 of the sequence number, length and record. */
+    uint16_t length;   /*!< The number of bytes in the record. */
+    uint16_t reserved; /*!< Left erased. */
+  } check;
+} TConfigPhrase;
+
+//the Flash sectors holding the two copies
+static const uint32_t SectorAddress[2] = {FLASH_CONFIG_SECTOR_A, FLASH_CONFIG_SECTOR_B};
+
+//the sector holding the newest valid copy, if there is one, and its sequence number
+static bool HaveActive;
+static uint8_t ActiveSector;
+static uint32_t ActiveSequence;
+
+//only one thread at a time can save
+static OS_ECB* ConfigMutex;
+
+/*************************function prototypes***************************/
+static uint32_t RecordCRC(const uint32_t sequence, const uint16_t length, const volatile void* const data);
+
+static bool IsCopyValid(const uint8_t sector, uint32_t* const sequence, uint16_t* const length);
+
+static bool WriteCopy(const uint8_t sector, const uint32_t sequence, const void* const data, const uint16_t length);
+/***********************************************************************/
+
+bool Config_Init(void* const data, const uint16_t length)
+{
+  uint32_t sequence[2];
+  uint16_t storedLength[2];
+  bool valid[2];
+
+  ConfigMutex = OS_SemaphoreCreate(1);
+
+  //one pass over both headers decides which copy is the newest
+  valid[0] = IsCopyValid(0, &sequence[0], &storedLength[0]);
+  valid[1] = IsCopyValid(1, &sequence[1], &storedLength[1]);
+
+  HaveActive = valid[0] || valid[1];
+  if (!HaveActive)
+    return FALSE;
+
+  if (valid[0] && valid[1])
+    ActiveSector = ((int32_t)(sequence[1] - sequence[0]) > 0) ? 1 : 0;
+  else
+    ActiveSector = valid[1] ? 1 : 0;
+
+  ActiveSequence = sequence[ActiveSector];
+
+  //a record of a different layout is not restored, but a new save will still follow on from it
+  if (storedLength[ActiveSector] != length)
+    return FALSE;
+
+  for (uint16_t i = 0; i < length; i++)
+    ((uint8_t*)data)[i] = _FB(SectorAddress[ActiveSector] + CONFIG_DATA_OFFSET + i);
+
+  return TRUE;
+}
+
+
+bool Config_Save(const void* const data, const uint16_t length)
+{
+  uint8_t target;
+  uint32_t sequence;
+  bool success = FALSE;
+
+  if (data == NULL || length > CONFIG_MAX_SIZE)
+    return FALSE;
+
+  (void)OS_SemaphoreWait(ConfigMutex, 0);
+
+  target = HaveActive ? (1 - ActiveSector) : 0;
+  sequence = HaveActive ? (ActiveSequence + 1) : 0;
+
+  for (uint8_t attempt = 0; !success && attempt < CONFIG_SAVE_ATTEMPTS; attempt++)
+    success = WriteCopy(target, sequence, data, length);
+
+  if (success)
+    {
+      //the old copy is superseded by the sequence number anyway, so a failure here is not an error
+      if (HaveActive)
+	(void)Flash_WritePhrase(SectorAddress[ActiveSector] + CONFIG_INVALID_OFFSET, 0);
+
+      HaveActive = TRUE;
+      ActiveSector = target;
+      ActiveSequence = sequence;
+    }
+
+  (void)OS_SemaphoreSignal(ConfigMutex);
+  return success;
+}
+
+void Config_Lock(void)
+{
+  (void)OS_SemaphoreWait(ConfigMutex, 0);
+}
+
+
+void Config_Unlock(void)
+{
+  (void)OS_SemaphoreSignal(ConfigMutex);
+}
+
+/*! @brief Calculates the CRC protecting a record.
+ *
+ *  @param sequence The sequence number of the copy.
+ *  @param length The number of bytes in the record.
+ *  @param data The record.
+ *  @return uint32_t - The CRC-32 of the sequence number, length and record.
+ */
+static uint32_t RecordCRC(const uint32_t sequence, const uint16_t length, const volatile void* const data)
+{
+  uint32_t crc;
+
+  crc = CRC_Calculate(0, &sequence, sizeof(sequence));
+  crc = CRC_Calculate(crc, &length, sizeof(length));
+  return CRC_Calculate(crc, data, length);
+}
+
+/*! @brief Checks whether a sector holds a complete copy that has not been invalidated.
+ *
+ *  @param sector The sector to check (0 or 1).
+ *  @param sequence Where to store the sequence number of the copy.
+ *  @param length Where to store the length of the record.
+ *  @return bool - TRUE if the copy is valid.
+ */
+static bool IsCopyValid(const uint8_t sector, uint32_t* const sequence, uint16_t* const length)
+{
+  TConfigPhrase header, check;
+
+  header.phrase = _FP(SectorAddress[sector] + CONFIG_HEADER_OFFSET);
+  check.phrase = _FP(SectorAddress[sector] + CONFIG_CHECK_OFFSET);
+
+  *sequence = header.header.sequence;
+  *length = check.check.length;
+
+  if (header.header.magic != CONFIG_MAGIC || _FP(SectorAddress[sector] + CONFIG_INVALID_OFFSET) != 0xFFFFFFFFFFFFFFFFULL ||
+      check.check.length > CONFIG_MAX_SIZE)
+    return FALSE;
+
+  return (RecordCRC(header.header.sequence, check.check.length, (const volatile void*)(SectorAddress[sector] + CONFIG_DATA_OFFSET)) == check.check.crc);
+}
+
+/*! @brief Erases a sector and writes a complete copy of the record to it.
+ *
+ *  @param sector The sector to write, 0 or 1.
+ *  @param sequence The sequence number of the new copy.
+ *  @param data The record.
+ *  @param length The number of bytes in the record.
+ *  @return bool - TRUE if the copy was written, FALSE if an erase, write or check failed part way.
+ *  @note Assumes the caller holds ConfigMutex.
+ */
+static bool WriteCopy(const uint8_t sector, const uint32_t sequence, const void* const data, const uint16_t length)
+{
+  TConfigPhrase entry;
+  bool success;
+
+  success = Flash_EraseSector(SectorAddress[sector]);
+
+  //the record, padded with erased bytes to a whole number of phrases
+  for (uint16_t i = 0; success && i < length; i += 8)
+    {
+      entry.phrase = 0xFFFFFFFFFFFFFFFFULL;
+      for (uint8_t j = 0; j < 8 && (i + j) < length; j++)
+	((uint8_t*)&entry.phrase)[j] = ((const uint8_t*)data)[i + j];
+
+      success = Flash_WritePhrase(SectorAddress[sector] + CONFIG_DATA_OFFSET + i, entry.phrase);
+    }
+
+  if (success)
+    {
+      entry.check.crc = RecordCRC(sequence, length, data);
+      entry.check.length = length;
+      entry.check.reserved = 0xFFFF;
+      success = Flash_WritePhrase(SectorAddress[sector] + CONFIG_CHECK_OFFSET, entry.phrase);
+    }
+
+  //the new copy becomes valid only once its header is programmed
+  if (success)
+    {
+      entry.header.magic = CONFIG_MAGIC;
+      entry.header.sequence = sequence;
+      success = Flash_WritePhrase(SectorAddress[sector] + CONFIG_HEADER_OFFSET, entry.phrase);
+    }
+
+  return success;
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,60 @@
+/*! @file
+ *
+ *  @brief Routines for storing the tower configuration in Flash.
+ *
+ *  This contains the functions for saving and restoring a configuration record.
+ *  The record is kept in two alternating sectors so that a power failure during a save
+ *  always leaves one complete, CRC-protected copy behind.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-21
+ */
+/*!
+**  @addtogroup Config_module Config module documentation
+**  @{
+*/
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// new types
+#include "types.h"
+
+// Maximum number of bytes in a configuration record
+#define CONFIG_MAX_SIZE 256
+
+/*! @brief Sets up the configuration storage and restores the newest valid record.
+ *
+ *  @param data Where to store the restored record.
+ *  @param length The number of bytes in the record.
+ *  @return bool - TRUE if a valid record of the given length was found, FALSE if there is none and data was left unchanged.
+ *  @note Assumes Flash has been initialized.
+ */
+bool Config_Init(void* const data, const uint16_t length);
+
+/*! @brief Saves a new configuration record.
+ *
+ *  The new copy is written to the unused sector and only then is the previous copy invalidated.
+ *  If the write or its check fails, the sector is erased and written once more before giving up.
+ *  @param data The record to save.
+ *  @param length The number of bytes in the record, at most CONFIG_MAX_SIZE.
+ *  @return bool - TRUE if the record was saved successfully.
+ *  @note Assumes the configuration storage has been initialized.
+ */
+bool Config_Save(const void* const data, const uint16_t length);
+
+/*! @brief Holds off saves, so the configuration sectors can be copied.
+ *
+ *  Waits for a save in progress to finish. Config_Save then waits until Config_Unlock is called.
+ *  @note Assumes the configuration storage has been initialized.
+ */
+void Config_Lock(void);
+
+/*! @brief Lets saves go ahead again after Config_Lock.
+ */
+void Config_Unlock(void);
+
+#endif
+
+/*!
+** @}
+*/
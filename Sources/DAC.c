@@ -0,0 +1,272 @@
+/*! @file
+ *
+ *  @brief Routines for writing to the DAC and playing waveforms on it.
+ *
+ *  This contains the functions for writing analog values to the LTC2704 DAC on the TWR-ADCDAC-LTC board,
+ *  and for playing a waveform on one of its outputs. The DAC is 16-bit, and configured with a bipolar voltage range of +/- 10V.
+ *  The DAC shares the SPI with the ADC, so a waveform cannot play while the acquisition engine is running.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-26
+ */
+/*!
+**  @addtogroup DAC_module DAC module documentation
+**  @{
+*/
+// header files used
+#include "DAC.h"
+#include "analog.h"
+#include "SPI.h"
+#include "PIT.h"
+#include "MK70F12.h"
+#include "PE_Types.h"
+#include "OS.h"
+
+//DMA channel 3 is the one PIT channel 3 triggers, and carries the waveform to the SPI
+#define DMA_WAVE_CHANNEL 3
+//another of the sources that is always requesting, as the acquisition engine uses the last one
+#define DMAMUX_SOURCE_ALWAYS_ON 62
+
+//the LTC2704 commands, which go with an address in the low byte of the first half of each 32-bit word
+#define LTC2704_WRITE_SPAN_UPDATE 0x6
+#define LTC2704_WRITE_CODE_UPDATE 0x7
+#define LTC2704_ADDRESS_ALL 0xF
+#define LTC2704_SPAN_BIPOLAR_10V 0x3
+//the bipolar codes are offset binary, where 0x8000 is 0V
+#define LTC2704_CODE(value) ((uint16_t)(value) ^ 0x8000)
+
+//the address of each output
+static const uint8_t Channel_Address[DAC_NB_OUTPUTS] = {0x0, 0x2, 0x4, 0x6};
+
+static const uint8_t DAC_Address = 0x0;
+
+//one quarter of a sine cycle, from 0 to 90 degrees in 64 steps
+static const int16_t Sine_Table[65] =
+{
+      0,   804,  1608,  2410,  3212,  4011,  4808,  5602,
+   6393,  7179,  7962,  8739,  9512, 10278, 11039, 11793,
+  12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+  18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+  23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+  27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+  30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+  32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+  32767
+};
+
+//the waveform that is loaded
+static int16_t Wave[DAC_WAVE_SIZE];
+static uint16_t WaveLength;
+
+//the words pushed by DMA, two for each sample of the waveform that is playing
+static uint32_t WaveCommands[2 * DAC_WAVE_SIZE];
+static bool Playing;
+
+/*************************function prototypes***************************/
+static void Write(const uint8_t command, const uint8_t address, const uint16_t data);
+
+static int16_t ShapeSample(const TDACWaveShape shape, const uint8_t phase);
+/***********************************************************************/
+
+
+bool DAC_Init(void)
+{
+  Playing = FALSE;
+  WaveLength = 0;
+
+  //enable the DMA and its multiplexer for the waveform player
+  SIM_SCGC6 |= SIM_SCGC6_DMAMUX0_MASK;
+  SIM_SCGC7 |= SIM_SCGC7_DMA_MASK;
+
+  //no other thread uses the SPI before the PIT is set up, so this does not need to be locked
+  Write(LTC2704_WRITE_SPAN_UPDATE, LTC2704_ADDRESS_ALL, LTC2704_SPAN_BIPOLAR_10V);
+  Write(LTC2704_WRITE_CODE_UPDATE, LTC2704_ADDRESS_ALL, LTC2704_CODE(0));
+
+  return TRUE;
+}
+
+
+bool DAC_Put(const uint8_t channelNb, const int16_t value)
+{
+  bool success = FALSE;
+
+  if (channelNb >= DAC_NB_OUTPUTS)
+    return FALSE;
+
+  SPI_Lock();
+  if (!Playing && !Analog_IsAcquiring())
+    {
+      Write(LTC2704_WRITE_CODE_UPDATE, Channel_Address[channelNb], LTC2704_CODE(value));
+      success = TRUE;
+    }
+  SPI_Unlock();
+
+  return success;
+}
+
+
+bool DAC_SetShape(const TDACWaveShape shape, const uint16_t length)
+{
+  if (shape > DAC_WAVE_SAWTOOTH || length == 0 || length > DAC_WAVE_SIZE)
+    return FALSE;
+
+  //the cycle is 256 steps of phase, whatever its length
+  for (uint16_t i = 0; i < length; i++)
+    Wave[i] = ShapeSample(shape, (uint8_t)((i * 256) / length));
+
+  WaveLength = length;
+  return TRUE;
+}
+
+
+bool DAC_SetSample(const uint16_t index, const int16_t value)
+{
+  if (index == 0)
+    WaveLength = 0;
+
+  if (index > WaveLength || index >= DAC_WAVE_SIZE)
+    return FALSE;
+
+  Wave[index] = value;
+  if (index == WaveLength)
+    WaveLength++;
+
+  return TRUE;
+}
+
+
+bool DAC_Play(const uint8_t channelNb, const uint32_t period)
+{
+  if (channelNb >= DAC_NB_OUTPUTS || period < DAC_MIN_PERIOD || WaveLength == 0)
+    return FALSE;
+
+  DAC_Stop();
+
+  SPI_Lock();
+
+  //the acquisition engine has the SPI while it runs
+  if (Analog_IsAcquiring())
+    {
+      SPI_Unlock();
+      return FALSE;
+    }
+
+  //from here on Analog_Get, Analog_Scan and Analog_Start leave the SPI to the player
+  Playing = TRUE;
+
+  //each 32-bit word is two frames, with the chip select held from the command to the end of the code
+  for (uint16_t i = 0; i < WaveLength; i++)
+    {
+      WaveCommands[2 * i] = SPI_Command((LTC2704_WRITE_CODE_UPDATE << 4) | Channel_Address[channelNb], DAC_CTAS, TRUE);
+      WaveCommands[2 * i + 1] = SPI_Command(LTC2704_CODE(Wave[i]), DAC_CTAS, FALSE);
+    }
+
+  SPI_SelectSlaveDevice(DAC_Address);
+  SPI_Unlock();
+
+  //the wave channel pushes one sample, both of its words, per trigger, and goes back to the first sample after each cycle
+  DMA_TCD3_SADDR = (uint32_t)&WaveCommands[0];
+  DMA_TCD3_SOFF = sizeof(WaveCommands[0]);
+  DMA_TCD3_ATTR = DMA_ATTR_SSIZE(2) | DMA_ATTR_DSIZE(2);
+  DMA_TCD3_NBYTES_MLNO = 2 * sizeof(WaveCommands[0]);
+  DMA_TCD3_SLAST = -(int32_t)(2 * WaveLength * sizeof(WaveCommands[0]));
+  DMA_TCD3_DADDR = (uint32_t)&SPI2_PUSHR;
+  DMA_TCD3_DOFF = 0;
+  DMA_TCD3_DLASTSGA = 0;
+  DMA_TCD3_CITER_ELINKNO = DMA_CITER_ELINKNO_CITER(WaveLength);
+  DMA_TCD3_BITER_ELINKNO = DMA_BITER_ELINKNO_BITER(WaveLength);
+  DMA_TCD3_CSR = 0;
+
+  DMAMUX0_CHCFG3 = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_TRIG_MASK | DMAMUX_CHCFG_SOURCE(DMAMUX_SOURCE_ALWAYS_ON);
+  DMA_SERQ = DMA_SERQ_SERQ(DMA_WAVE_CHANNEL);
+
+  PIT_SetTrigger(DMA_WAVE_CHANNEL, period);
+
+  return TRUE;
+}
+
+
+void DAC_Stop(void)
+{
+  if (!Playing)
+    return;
+
+  PIT_SetTrigger(DMA_WAVE_CHANNEL, 0);
+  DMA_CERQ = DMA_CERQ_CERQ(DMA_WAVE_CHANNEL);
+  DMAMUX0_CHCFG3 = 0;
+
+  //let the last word finish, then drop what the DAC sent back while the waveform played
+  while (SPI2_SR & SPI_SR_TXCTR_MASK)
+    {/*wait*/}
+  OS_TimeDelay(1);
+  SPI_SetDMA(FALSE);
+
+  Playing = FALSE;
+}
+
+
+bool DAC_IsPlaying(void)
+{
+  return Playing;
+}
+
+/*! @brief Sends a 32-bit word to the DAC.
+ *
+ *  @param command is the LTC2704 command.
+ *  @param address is the address of the output, or LTC2704_ADDRESS_ALL.
+ *  @param data is the code or span.
+ *  @note Assumes the caller has locked the SPI.
+ */
+static void Write(const uint8_t command, const uint8_t address, const uint16_t data)
+{
+  uint16_t dataTx[2];
+
+  dataTx[0] = (command << 4) | address;
+  dataTx[1] = data;
+
+  SPI_SelectSlaveDevice(DAC_Address);
+  SPI_ExchangeBatch(dataTx, NULL, 2, DAC_CTAS, TRUE);
+}
+
+/*! @brief Looks up a sample of a waveform.
+ *
+ *  @param shape is the shape of the waveform.
+ *  @param phase is the position in the cycle, in 256 steps.
+ *  @return int16_t - The sample.
+ */
+static int16_t ShapeSample(const TDACWaveShape shape, const uint8_t phase)
+{
+  uint8_t step = phase & 0x3F;
+
+  switch (shape)
+  {
+    //the other three quarters of the sine are the first quarter reflected
+    case DAC_WAVE_SINE:
+      switch (phase >> 6)
+      {
+	case 0:
+	  return Sine_Table[step];
+	case 1:
+	  return Sine_Table[64 - step];
+	case 2:
+	  return -Sine_Table[step];
+	default:
+	  return -Sine_Table[64 - step];
+      }
+
+    case DAC_WAVE_SQUARE:
+      return (phase < 128) ? 32767 : -32767;
+
+    case DAC_WAVE_TRIANGLE:
+      if (phase < 128)
+	return (int16_t)(-32767 + ((int32_t)phase * 65534) / 128);
+      return (int16_t)(32767 - ((int32_t)(phase - 128) * 65534) / 128);
+
+    default:
+      return (int16_t)(-32767 + ((int32_t)phase * 65534) / 255);
+  }
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,107 @@
+/*! @file
+ *
+ *  @brief Routines for writing to the DAC and playing waveforms on it.
+ *
+ *  This contains the functions for writing analog values to the LTC2704 DAC on the TWR-ADCDAC-LTC board,
+ *  and for playing a waveform on one of its outputs. The DAC is 16-bit, and configured with a bipolar voltage range of +/- 10V.
+ *  The DAC shares the SPI with the ADC, so a waveform cannot play while the acquisition engine is running.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-26
+ */
+/*!
+**  @addtogroup DAC_module DAC module documentation
+**  @{
+*/
+#ifndef DAC_H
+#define DAC_H
+
+// new types
+#include "types.h"
+
+// Number of outputs
+#define DAC_NB_OUTPUTS 4
+
+// Maximum number of samples in a waveform
+#define DAC_WAVE_SIZE 256
+
+// Shortest sample period of a waveform in nanoseconds, the time to send a 32-bit word to the DAC
+#define DAC_MIN_PERIOD 5000
+
+// The SPI transfer attributes of the DAC, the fastest SCK it accepts in Hz, and the time its chip select has to stay high after a word in nanoseconds
+#define DAC_CTAS 1
+#define DAC_MAX_BAUD_RATE 50000000
+#define DAC_LOAD_TIME 100
+
+// The waveforms that can be built from a lookup table
+typedef enum
+{
+  DAC_WAVE_SINE,
+  DAC_WAVE_SQUARE,
+  DAC_WAVE_TRIANGLE,
+  DAC_WAVE_SAWTOOTH
+} TDACWaveShape;
+
+/*! @brief Sets up the DAC before first use.
+ *
+ *  Sets every output to the +/- 10V range and to 0V.
+ *  @return bool - TRUE if the DAC was successfully initialized.
+ *  @note Assumes that the analog module, and so the SPI, has been initialized, and that it is called before the PIT is set up, when no other thread uses the SPI.
+ */
+bool DAC_Init(void);
+
+/*! @brief Sets the value of an output.
+ *
+ *  @param channelNb is the number of the output.
+ *  @param value is the value, from -32768 for -10V to 32767 for just under +10V.
+ *  @return bool - TRUE if the value was written, FALSE if the channel is not valid or the SPI is being used by DMA.
+ */
+bool DAC_Put(const uint8_t channelNb, const int16_t value);
+
+/*! @brief Builds one cycle of a waveform from a lookup table.
+ *
+ *  The waveform is full scale, and replaces the waveform that was loaded before. A waveform that is playing is not changed until it is played again.
+ *  @param shape is the shape of the waveform.
+ *  @param length is the number of samples in the cycle, up to DAC_WAVE_SIZE.
+ *  @return bool - TRUE if the waveform was built.
+ */
+bool DAC_SetShape(const TDACWaveShape shape, const uint16_t length);
+
+/*! @brief Loads one sample of a waveform.
+ *
+ *  The samples of a waveform are loaded in order, and loading sample 0 starts a new waveform.
+ *  A waveform that is playing is not changed until it is played again.
+ *  @param index is the position of the sample in the cycle.
+ *  @param value is the value of the sample.
+ *  @return bool - TRUE if the sample was loaded, FALSE if it is not the next sample or there is no room for it.
+ */
+bool DAC_SetSample(const uint16_t index, const int16_t value);
+
+/*! @brief Starts playing the waveform on an output, over and over.
+ *
+ *  PIT channel 3 triggers a DMA transfer of the next sample to the SPI each period, so no software runs per sample.
+ *  A waveform that is already playing is stopped first.
+ *  @param channelNb is the number of the output.
+ *  @param period is the time between samples in nanoseconds, at least DAC_MIN_PERIOD.
+ *  @return bool - TRUE if the waveform is playing, FALSE if no waveform is loaded or the acquisition engine is running.
+ *  @note Assumes that the PIT has been initialized.
+ */
+bool DAC_Play(const uint8_t channelNb, const uint32_t period);
+
+/*! @brief Stops playing the waveform.
+ *
+ *  The output stays at the last sample played.
+ */
+void DAC_Stop(void);
+
+/*! @brief Checks whether a waveform is playing.
+ *
+ *  @return bool - TRUE if a waveform is playing.
+ */
+bool DAC_IsPlaying(void);
+
+#endif
+
+/*!
+** @}
+*/
@@ -0,0 +1,32 @@
+/*! @file
+ *
+ *  @brief Definitions for the DWT cycle counter.
+ *
+ *  This contains the enable bits and the clock conversion used wherever the core clock cycle counter
+ *  times something, so the counter is set up the same way by everything that uses it.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-27
+ */
+/*!
+**  @addtogroup DWT_module DWT module documentation
+**  @{
+*/
+
+#ifndef DWT_H
+#define DWT_H
+
+#include "Cpu.h"
+
+//enable bit for the cycle counter in DWT_CTRL
+#define DWT_CTRL_CYCCNTENA_MASK 0x00000001LU
+//enable bit for the DWT and ITM units in DEMCR, needed before the cycle counter runs
+#define DEMCR_TRCENA_MASK       0x01000000LU
+//core clock cycles in a microsecond
+#define CYCLES_PER_US (CPU_CORE_CLK_HZ / 1000000)
+
+#endif
+
+/*!
+** @}
+*/
@@ -0,0 +1,336 @@
+/*! @file
+ *
+ *  @brief Routines for emulated EEPROM storage of frequently written variables.
+ *
+ *  This contains the functions for storing small non-volatile variables that are written often,
+ *  such as counters. Each write is appended to a log in Flash instead of erasing a sector,
+ *  spreading wear over two alternating sectors.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-20
+ */
+/*!
+**  @addtogroup EEPROM_module EEPROM module documentation
+**  @{
+*/
+// header files used
+#include "EEPROM.h"
+#include "Flash.h"
+#include "PE_Types.h"
+#include "OS.h"
+
+//number of 32-bit words in the emulated EEPROM
+#define EEPROM_NB_WORDS (EEPROM_SIZE / 4)
+//identifies a sector header written by this module
+#define EEPROM_MAGIC 0x45454531LU
+//number of 8-byte records that fit in a sector after its header
+#define EEPROM_NB_RECORDS ((FLASH_SECTOR_SIZE / 8) - 1)
+
+/*!
+ * Each sector starts with a header phrase, followed by records.
+ * A record holds the new value of one 32-bit word of the EEPROM.
+ */
+typedef union
+{
+  uint64_t phrase;
+  struct
+  {
+    uint16_t wordNb;   /*!< The index of the word in the EEPROM. */
+    uint16_t check;    /*!< The complement of wordNb, so erased or partly programmed records are ignored. */
+    uint32_t value;    /*!< The new value of the word. */
+  } record;
+  struct
+  {
+    uint32_t magic;    /*!< EEPROM_MAGIC if the sector holds a complete copy of the EEPROM. */
+    uint32_t sequence; /*!< Incremented each time the EEPROM moves to the other sector. */
+  } header;
+} TEEPROMPhrase;
+
+//the Flash sectors used by the EEPROM
+static const uint32_t SectorAddress[2] = {FLASH_EEPROM_SECTOR_A, FLASH_EEPROM_SECTOR_B};
+
+//RAM copy of the EEPROM, read directly by the users of allocated variables
+static uint32union_t Shadow[EEPROM_NB_WORDS];
+//the sector being appended to, its sequence number and the next free record in it
+static uint8_t ActiveSector;
+static uint32_t ActiveSequence;
+static uint16_t NextRecord;
+//number of bytes handed out by EEPROM_AllocateVar
+static uint8_t Allocated;
+
+//only one thread at a time can append to the log
+static OS_ECB* EEPROMMutex;
+
+/*************************function prototypes***************************/
+static bool IsHeaderValid(const uint8_t sector, uint32_t* const sequence);
+
+static bool Replay(const uint8_t sector);
+
+static bool MoveToSector(const uint8_t sector);
+
+static bool WriteWord(const uint8_t wordNb, const uint32_t value);
+
+static bool AppendRecord(const uint8_t wordNb, const uint32_t value);
+/***********************************************************************/
+
+bool EEPROM_Init(void)
+{
+  uint32_t sequence[2];
+  bool valid[2];
+
+  EEPROMMutex = OS_SemaphoreCreate(1);
+  Allocated = 0;
+
+  for (uint8_t i = 0; i < EEPROM_NB_WORDS; i++)
+    Shadow[i].l = 0xFFFFFFFF;
+
+  valid[0] = IsHeaderValid(0, &sequence[0]);
+  valid[1] = IsHeaderValid(1, &sequence[1]);
+
+  //use the newest complete sector, allowing for the sequence number wrapping around
+  if (valid[0] && valid[1])
+    return Replay(((int32_t)(sequence[1] - sequence[0]) > 0) ? 1 : 0);
+  if (valid[0])
+    return Replay(0);
+  if (valid[1])
+    return Replay(1);
+
+  //nothing has been stored yet, so format the first sector
+  ActiveSector = 1;
+  ActiveSequence = 0;
+  return MoveToSector(0);
+}
+
+
+bool EEPROM_AllocateVar(volatile void** variable, const uint8_t size)
+{
+  uint8_t start;
+
+  if (size != 1 && size != 2 && size != 4)
+    return FALSE;
+
+  //round up to the natural alignment of the variable
+  start = (Allocated + (size - 1)) & ~(size - 1);
+  if (start + size > EEPROM_SIZE)
+    return FALSE;
+
+  *variable = (uint8_t*)Shadow + start;
+  Allocated = start + size;
+  return TRUE;
+}
+
+
+bool EEPROM_Write32(volatile uint32_t* const address, const uint32_t data)
+{
+  uint32_t offset = (uint32_t)address - (uint32_t)Shadow;
+
+  if ((uint32_t)address < (uint32_t)Shadow || offset >= EEPROM_SIZE || (offset % 4))
+    return FALSE;
+
+  return WriteWord(offset / 4, data);
+}
+
+
+bool EEPROM_Write16(volatile uint16_t* const address, const uint16_t data)
+{
+  uint32_t offset = (uint32_t)address - (uint32_t)Shadow;
+  uint32union_t word;
+
+  if ((uint32_t)address < (uint32_t)Shadow || offset >= EEPROM_SIZE || (offset % 2))
+    return FALSE;
+
+  //writes in 16 bits to the high or low part of the word depending on the address
+  word = Shadow[offset / 4];
+  if ((offset / 2) % 2)
+    word.s.Hi = data;
+  else
+    word.s.Lo = data;
+
+  return WriteWord(offset / 4, word.l);
+}
+
+
+bool EEPROM_Write8(volatile uint8_t* const address, const uint8_t data)
+{
+  uint32_t offset = (uint32_t)address - (uint32_t)Shadow;
+  uint16union_t halfWord;
+
+  if ((uint32_t)address < (uint32_t)Shadow || offset >= EEPROM_SIZE)
+    return FALSE;
+
+  //writes in 8 bits to the high or low part of the half-word depending on the address
+  halfWord.l = *(uint16_t*)((uint8_t*)Shadow + (offset & ~0x01));
+  if (offset % 2)
+    halfWord.s.Hi = data;
+  else
+    halfWord.s.Lo = data;
+
+  return EEPROM_Write16((uint16_t*)((uint8_t*)Shadow + (offset & ~0x01)), halfWord.l);
+}
+
+void EEPROM_Lock(void)
+{
+  (void)OS_SemaphoreWait(EEPROMMutex, 0);
+}
+
+
+void EEPROM_Unlock(void)
+{
+  (void)OS_SemaphoreSignal(EEPROMMutex);
+}
+
+/*! @brief Checks whether a sector holds a complete copy of the EEPROM.
+ *
+ *  @param sector The sector to check (0 or 1).
+ *  @param sequence Where to store the sequence number of the sector.
+ *  @return bool - TRUE if the sector header is valid.
+ */
+static bool IsHeaderValid(const uint8_t sector, uint32_t* const sequence)
+{
+  TEEPROMPhrase header;
+
+  header.phrase = _FP(SectorAddress[sector]);
+  *sequence = header.header.sequence;
+
+  return (header.header.magic == EEPROM_MAGIC);
+}
+
+/*! @brief Restores the EEPROM from a sector and finds the next free record.
+ *
+ *  @param sector The sector to replay (0 or 1).
+ *  @return bool - TRUE if the EEPROM was restored.
+ */
+static bool Replay(const uint8_t sector)
+{
+  TEEPROMPhrase entry;
+  uint16_t i;
+
+  ActiveSector = sector;
+  (void)IsHeaderValid(sector, &ActiveSequence);
+
+  //later records override earlier ones, the log ends at the first erased phrase
+  for (i = 0; i < EEPROM_NB_RECORDS; i++)
+    {
+      entry.phrase = _FP(SectorAddress[sector] + 8 * (i + 1));
+
+      if (entry.phrase == 0xFFFFFFFFFFFFFFFFULL)
+	break;
+
+      if ((uint16_t)(entry.record.check ^ entry.record.wordNb) == 0xFFFF && entry.record.wordNb < EEPROM_NB_WORDS)
+	Shadow[entry.record.wordNb].l = entry.record.value;
+    }
+
+  NextRecord = i;
+
+  //a full sector is compacted into the other one straight away
+  if (NextRecord == EEPROM_NB_RECORDS)
+    return MoveToSector(1 - ActiveSector);
+
+  return TRUE;
+}
+
+/*! @brief Copies the EEPROM into a freshly erased sector and makes it the active sector.
+ *
+ *  The header is written last, so the previous sector stays valid until the copy is complete.
+ *  @param sector The sector to move to (0 or 1).
+ *  @return bool - TRUE if the sector was erased and every record and the header were written.
+ */
+static bool MoveToSector(const uint8_t sector)
+{
+  TEEPROMPhrase entry;
+  uint8_t previousSector = ActiveSector;
+  uint16_t previousRecord = NextRecord;
+  bool success;
+
+  success = Flash_EraseSector(SectorAddress[sector]);
+
+  ActiveSector = sector;
+  NextRecord = 0;
+
+  //only words that differ from the erased state need a record
+  for (uint8_t i = 0; success && i < EEPROM_NB_WORDS; i++)
+    if (Shadow[i].l != 0xFFFFFFFF)
+      success = AppendRecord(i, Shadow[i].l);
+
+  if (success)
+    {
+      entry.header.magic = EEPROM_MAGIC;
+      entry.header.sequence = ActiveSequence + 1;
+      success = Flash_WritePhrase(SectorAddress[sector], entry.phrase);
+    }
+
+  //the previous sector is still the valid one if the copy could not be completed
+  if (!success)
+    {
+      ActiveSector = previousSector;
+      NextRecord = previousRecord;
+      return FALSE;
+    }
+
+  ActiveSequence++;
+  return TRUE;
+}
+
+/*! @brief Updates a word of the EEPROM and appends a record of it to the active sector.
+ *
+ *  If the active sector is full, or no record could be written in what is left of it, the EEPROM moves to the other sector.
+ *  @param wordNb The index of the word to write.
+ *  @param value The new value of the word.
+ *  @return bool - TRUE if the new value is in Flash, FALSE if it could not be written and the word keeps its old value.
+ */
+static bool WriteWord(const uint8_t wordNb, const uint32_t value)
+{
+  uint32_t previous;
+  bool success = TRUE;
+
+  (void)OS_SemaphoreWait(EEPROMMutex, 0);
+
+  //writing the same value again would only wear the Flash
+  if (Shadow[wordNb].l != value)
+    {
+      previous = Shadow[wordNb].l;
+      Shadow[wordNb].l = value;
+
+      if (!AppendRecord(wordNb, value))
+	success = MoveToSector(1 - ActiveSector); //the shadow already holds the new value
+
+      //the valid sector still holds the old value, so the RAM copy has to match it
+      if (!success)
+	Shadow[wordNb].l = previous;
+    }
+
+  (void)OS_SemaphoreSignal(EEPROMMutex);
+  return success;
+}
+
+/*! @brief Appends a record to the active sector.
+ *
+ *  If the record fails to program, or fails its check when the Flash verify stage is on, it is written again in the next free position.
+ *  The failed record is either ignored on replay because of its check field, or overridden by the later copy.
+ *  @param wordNb The index of the word.
+ *  @param value The value of the word.
+ *  @return bool - TRUE if the record was written, FALSE if the sector is full.
+ */
+static bool AppendRecord(const uint8_t wordNb, const uint32_t value)
+{
+  TEEPROMPhrase entry;
+
+  entry.record.wordNb = wordNb;
+  entry.record.check = (uint16_t)~wordNb;
+  entry.record.value = value;
+
+  while (NextRecord < EEPROM_NB_RECORDS)
+    {
+      uint32_t address = SectorAddress[ActiveSector] + 8 * (NextRecord + 1);
+
+      NextRecord++;
+      if (Flash_WritePhrase(address, entry.phrase))
+	return TRUE;
+    }
+
+  return FALSE;
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,90 @@
+/*! @file
+ *
+ *  @brief Routines for emulated EEPROM storage of frequently written variables.
+ *
+ *  This contains the functions for storing small non-volatile variables that are written often,
+ *  such as counters. Each write is appended to a log in Flash instead of erasing a sector,
+ *  spreading wear over two alternating sectors.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-20
+ */
+/*!
+**  @addtogroup EEPROM_module EEPROM module documentation
+**  @{
+*/
+#ifndef EEPROM_H
+#define EEPROM_H
+
+// new types
+#include "types.h"
+
+// Number of bytes of emulated EEPROM available for variables
+#define EEPROM_SIZE 64
+
+/*! @brief Sets up the emulated EEPROM before first use.
+ *
+ *  Finds the newest valid log sector and replays it to restore the variables.
+ *  If no valid sector is found, the EEPROM is formatted with every byte set to 0xFF.
+ *  @return bool - TRUE if the emulated EEPROM was set up successfully.
+ *  @note Assumes Flash has been initialized and interrupts are enabled.
+ */
+bool EEPROM_Init(void);
+
+/*! @brief Allocates space for a non-volatile variable in the emulated EEPROM.
+ *
+ *  @param variable is the address of a pointer to a variable that is to be allocated space in the emulated EEPROM.
+ *         The pointer will be allocated to a relevant address:
+ *         If the variable is a byte, then any address.
+ *         If the variable is a half-word, then an even address.
+ *         If the variable is a word, then an address divisible by 4.
+ *         The variable can be read directly through the pointer, which refers to a RAM copy of the EEPROM.
+ *  @param size The size, in bytes, of the variable that is to be allocated space. Valid values are 1, 2 and 4.
+ *  @return bool - TRUE if the variable was allocated space in the emulated EEPROM.
+ *  @note Assumes the EEPROM has been initialized.
+ */
+bool EEPROM_AllocateVar(volatile void** variable, const uint8_t size);
+
+/*! @brief Writes a 32-bit number to the emulated EEPROM.
+ *
+ *  @param address The address of the data.
+ *  @param data The 32-bit data to write.
+ *  @return bool - TRUE if the value was written to Flash, FALSE if address is not a 4-byte aligned EEPROM address or there is a programming error, in which case the variable keeps its old value.
+ *  @note Assumes the EEPROM has been initialized. Waits for the Flash record to be programmed.
+ */
+bool EEPROM_Write32(volatile uint32_t* const address, const uint32_t data);
+
+/*! @brief Writes a 16-bit number to the emulated EEPROM.
+ *
+ *  @param address The address of the data.
+ *  @param data The 16-bit data to write.
+ *  @return bool - TRUE if the value was written to Flash, FALSE if address is not a 2-byte aligned EEPROM address or there is a programming error, in which case the variable keeps its old value.
+ *  @note Assumes the EEPROM has been initialized. Waits for the Flash record to be programmed.
+ */
+bool EEPROM_Write16(volatile uint16_t* const address, const uint16_t data);
+
+/*! @brief Writes an 8-bit number to the emulated EEPROM.
+ *
+ *  @param address The address of the data.
+ *  @param data The 8-bit data to write.
+ *  @return bool - TRUE if the value was written to Flash, FALSE if address is not an EEPROM address or there is a programming error, in which case the variable keeps its old value.
+ *  @note Assumes the EEPROM has been initialized. Waits for the Flash record to be programmed.
+ */
+bool EEPROM_Write8(volatile uint8_t* const address, const uint8_t data);
+
+/*! @brief Holds off writes, so the EEPROM sectors can be copied.
+ *
+ *  Waits for a write in progress to finish. EEPROM_Write32/16/8 then wait until EEPROM_Unlock is called.
+ *  @note Assumes the EEPROM has been initialized.
+ */
+void EEPROM_Lock(void);
+
+/*! @brief Lets writes go ahead again after EEPROM_Lock.
+ */
+void EEPROM_Unlock(void);
+
+#endif
+
+/*!
+** @}
+*/
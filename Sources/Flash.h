@@ -17,16 +17,88 @@
 // new types
 #include "types.h"
 
+#ifdef FLASH_SIM
+// host build, with the Flash and its registers simulated
+#include "FlashSim.h"
+#else
 // FLASH data access
 #define _FB(flashAddress)  *(uint8_t  volatile *)(flashAddress)
 #define _FH(flashAddress)  *(uint16_t volatile *)(flashAddress)
 #define _FW(flashAddress)  *(uint32_t volatile *)(flashAddress)
 #define _FP(flashAddress)  *(uint64_t volatile *)(flashAddress)
+#endif
+
+// Size of an erasable sector of the program Flash
+#define FLASH_SECTOR_SIZE 0x1000LU
+// Size of each half of the program Flash, which swap places when a firmware update is committed
+#define FLASH_HALF_SIZE 0x00080000LU
+// The running program is limited to the first 252 KB, followed by the sector holding the swap indicator
+#define FLASH_IMAGE_SIZE     0x0003F000LU
+#define FLASH_SWAP_INDICATOR 0x0003F000LU
+// Flash below this holds the running program and is never erased or written
+#define FLASH_WRITABLE_START 0x00040000LU
+// The upper half, where a firmware update is written (see Update.h)
+#define FLASH_UPDATE_START FLASH_HALF_SIZE
+// Block used for data storage, copied to the block below FLASH_UPDATE_START before the halves swap
+#define FLASH_STORAGE_START 0x000C0000LU
+#define FLASH_STORAGE_SIZE  0x00040000LU
+// Sectors holding the two alternating copies of the configuration record (see Config.h)
+#define FLASH_CONFIG_SECTOR_A 0x000C0000LU
+#define FLASH_CONFIG_SECTOR_B 0x000C1000LU
+// Sectors holding the emulated EEPROM log (see EEPROM.h)
+#define FLASH_EEPROM_SECTOR_A 0x000C2000LU
+#define FLASH_EEPROM_SECTOR_B 0x000C3000LU
+// Sector erased and programmed by Flash_Benchmark
+#define FLASH_BENCH_SECTOR 0x000C4000LU
+// Address of the start of the Flash sector we are using for data storage
+#define FLASH_DATA_START 0x000C5000LU
+// Address of the end of the Flash sector we are using for data storage
+#define FLASH_DATA_END   0x000C5007LU
+// Sectors holding the ring of logged samples (see Logger.h)
+#define FLASH_LOG_START      0x000C8000LU
+#define FLASH_LOG_NB_SECTORS 56
+// FlexRAM, used to stage data for the Program Section command
+#define FLASH_FLEXRAM_START 0x14000000LU
+#define FLASH_FLEXRAM_SIZE  0x4000LU
+// Number of bins in a latency histogram; bin n counts latencies of 2^n to 2^(n+1) - 1 us
+#define FLASH_HISTOGRAM_SIZE 16
+
+// The operations whose latency is measured
+typedef enum
+{
+  FLASH_STATS_ERASE,    /*!< Erase Sector command. */
+  FLASH_STATS_PHRASE,   /*!< Program Phrase command. */
+  FLASH_STATS_SECTION,  /*!< Program Section command. */
+  FLASH_STATS_MODIFY,   /*!< Read-modify-write of the data sector by Flash_Write32/16/8. */
+  FLASH_STATS_VERIFY,   /*!< Read 1s Section and Program Check commands of the verify stage. */
+  FLASH_NB_STATS
+} TFlashStatsType;
 
-// Address of the start of the Flash block we are using for data storage
-#define FLASH_DATA_START 0x00080000LU
-// Address of the end of the Flash block we are using for data storage
-#define FLASH_DATA_END   0x00080007LU
+// Swap control codes
+#define FLASH_SWAP_INITIALIZE   0x01
+#define FLASH_SWAP_SET_UPDATE   0x02
+#define FLASH_SWAP_SET_COMPLETE 0x04
+#define FLASH_SWAP_REPORT       0x08
+
+// The state of the swap system, as reported by the Swap Control command
+typedef enum
+{
+  FLASH_SWAP_UNINITIALIZED, /*!< No swap indicator has been set up. */
+  FLASH_SWAP_READY,         /*!< Ready for an update to begin. */
+  FLASH_SWAP_UPDATE,        /*!< An update has begun, the indicator in the upper half has to be erased. */
+  FLASH_SWAP_UPDATE_ERASED, /*!< The upper half can be written with the new image. */
+  FLASH_SWAP_COMPLETE       /*!< The halves swap at the next reset. */
+} TFlashSwapMode;
+
+// Latency statistics of one operation, in microseconds
+typedef struct
+{
+  uint32_t count;                                /*!< Number of operations measured. */
+  uint32_t min;                                  /*!< Shortest latency. */
+  uint32_t max;                                  /*!< Longest latency. */
+  uint64_t total;                                /*!< Sum of the latencies, to calculate the mean. */
+  uint16_t histogram[FLASH_HISTOGRAM_SIZE];      /*!< Number of operations in each bin, saturating at 0xFFFF. */
+} TFlashStats;
 
 /*! @brief Enables the Flash module.
  *
@@ -83,6 +155,130 @@ bool Flash_Write8(volatile uint8_t* const address, const uint8_t data);
  */
 bool Flash_Erase(void);
 
+/*! @brief Erases a Flash sector.
+ *
+ *  @param address The address of the start of the sector, at or above FLASH_WRITABLE_START.
+ *  @return bool - TRUE if the sector was erased successfully, FALSE if the address is not valid or there is an error.
+ *  @note Assumes Flash has been initialized.
+ */
+bool Flash_EraseSector(const uint32_t address);
+
+/*! @brief Writes a 64-bit phrase to erased Flash.
+ *
+ *  @param address The address of the phrase, at or above FLASH_WRITABLE_START and aligned to an 8-byte boundary.
+ *  @param phrase The 64-bit data to write.
+ *  @return bool - TRUE if Flash was written successfully, FALSE if the address is not valid or there is a programming error.
+ *  @note Assumes Flash has been initialized and the phrase has been erased.
+ */
+bool Flash_WritePhrase(const uint32_t address, const uint64_t phrase);
+
+/*! @brief Writes a block of data to erased Flash using the Program Section command.
+ *
+ *  The data is staged in the FlexRAM and programmed with one command per sector,
+ *  instead of one command per 8-byte phrase.
+ *  @param address The address to write to, at or above FLASH_WRITABLE_START and aligned to a 16-byte boundary.
+ *  @param data The data to write.
+ *  @param length The number of bytes to write, a multiple of 16.
+ *  @return bool - TRUE if Flash was written successfully, FALSE if the arguments are not valid or there is a programming error.
+ *  @note Assumes Flash has been initialized and the destination has been erased.
+ */
+bool Flash_WriteSection(const uint32_t address, const uint8_t* const data, const uint32_t length);
+
+/*! @brief Checks programmed Flash at the user margin read level with the Program Check command.
+ *
+ *  Every programmed longword is checked, so this is the full check to use on data that matters, such as
+ *  a new image. The range is checked in batches of commands queued back to back, and other threads can
+ *  use the Flash between batches. Longwords that are erased in the expected data were not programmed and are skipped.
+ *  @param address The address of the data, at or above FLASH_WRITABLE_START and aligned to a 4-byte boundary.
+ *  @param data The data that should be in the Flash.
+ *  @param length The number of bytes to check, a multiple of 4.
+ *  @return bool - TRUE if every longword reads back correctly, FALSE if the arguments are not valid or a check fails.
+ *  @note Assumes Flash has been initialized.
+ */
+bool Flash_Verify(const uint32_t address, const uint8_t* const data, const uint32_t length);
+
+/*! @brief Turns the verify stage on or off.
+ *
+ *  While it is on, Flash_Erase and Flash_EraseSector check the sector reads as erased with Read 1s Section,
+ *  Flash_WritePhrase and Flash_Write32/16/8 check every longword they wrote with Program Check, and
+ *  Flash_WriteSection checks each section with Read 1s Section over its erased units and Program Check on a sample of the rest.
+ *  A failed check is reported as a failed write, so the caller can retry somewhere else.
+ *  Queued commands are not verified.
+ *  @param enable TRUE to verify every erase and write.
+ */
+void Flash_SetVerify(const bool enable);
+
+/*! @brief Checks whether the verify stage is on.
+ *
+ *  @return bool - TRUE if erases and writes are verified.
+ */
+bool Flash_IsVerifying(void);
+
+/*! @brief Queues an erase of a Flash sector and returns without waiting for it to complete.
+ *
+ *  @param address The address of the start of the sector, at or above FLASH_WRITABLE_START.
+ *  @param userFunction is a pointer to a function called from the Flash thread with the outcome of the erase. May be NULL.
+ *  @param userArguments is a pointer to the user arguments to use with the user callback function.
+ *  @return bool - TRUE if the erase was queued, FALSE if the address is not a valid data sector.
+ *  @note Assumes Flash has been initialized. Blocks while the command queue is full.
+ */
+bool Flash_EraseSectorAsync(const uint32_t address, void (*userFunction)(void*, const bool), void* userArguments);
+
+/*! @brief Queues a write of a 64-bit phrase to Flash and returns without waiting for it to complete.
+ *
+ *  @param address The address of the phrase, at or above FLASH_WRITABLE_START and aligned to an 8-byte boundary.
+ *  @param phrase The 64-bit data to write. The phrase must have been erased beforehand.
+ *  @param userFunction is a pointer to a function called from the Flash thread with the outcome of the write. May be NULL.
+ *  @param userArguments is a pointer to the user arguments to use with the user callback function.
+ *  @return bool - TRUE if the write was queued, FALSE if the address is not valid.
+ *  @note Assumes Flash has been initialized. Blocks while the command queue is full.
+ */
+bool Flash_WritePhraseAsync(const uint32_t address, const uint64_t phrase, void (*userFunction)(void*, const bool), void* userArguments);
+
+/*! @brief Gets the latency statistics of an operation.
+ *
+ *  @param type The operation.
+ *  @param stats Filled in with a copy of the statistics.
+ *  @return bool - TRUE if the type is valid.
+ */
+bool Flash_GetStats(const TFlashStatsType type, TFlashStats* const stats);
+
+/*! @brief Clears the latency statistics of an operation.
+ *
+ *  @param type The operation.
+ *  @return bool - TRUE if the type is valid.
+ */
+bool Flash_ResetStats(const TFlashStatsType type);
+
+/*! @brief Repeatedly erases and programs FLASH_BENCH_SECTOR and measures how long each cycle takes.
+ *
+ *  The latency of each command is also added to the statistics.
+ *  @param cycles The number of erase/program cycles to run.
+ *  @param section TRUE to program the sector with Program Section, FALSE to program it one phrase at a time.
+ *  @param microseconds Set to the mean time taken by one cycle.
+ *  @return bool - TRUE if every cycle completed without error.
+ *  @note Assumes Flash has been initialized. Blocks the calling thread for the whole benchmark.
+ */
+bool Flash_Benchmark(const uint8_t cycles, const bool section, uint32_t* const microseconds);
+
+/*! @brief Runs the Swap Control command on the swap indicator at FLASH_SWAP_INDICATOR.
+ *
+ *  The command is run from RAM with interrupts disabled, as it can program the block the program runs from.
+ *  @param control The swap control code, one of FLASH_SWAP_INITIALIZE, FLASH_SWAP_SET_UPDATE, FLASH_SWAP_SET_COMPLETE or FLASH_SWAP_REPORT.
+ *  @param mode Set to the swap mode after the command.
+ *  @return bool - TRUE if the command completed without error.
+ *  @note Assumes Flash has been initialized.
+ */
+bool Flash_Swap(const uint8_t control, TFlashSwapMode* const mode);
+
+/*! @brief Interrupt service routine for the FTFE command complete interrupt.
+ *
+ *  Records the outcome of the finished command and launches the next queued command.
+ *  Executes from RAM so it can run while the program Flash is busy.
+ *  @note Assumes Flash has been initialized.
+ */
+void __attribute__ ((interrupt)) Flash_ISR(void);
+
 
 #endif
 
@@ -0,0 +1,392 @@
+/*! @file
+ *
+ *  @brief Simulation of the FTFE and program Flash for building the Flash module on a host PC.
+ *
+ *  This contains the simulated registers and memory used when the Flash module is built with FLASH_SIM defined.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-24
+ */
+/*!
+**  @addtogroup FlashSim_module FlashSim module documentation
+**  @{
+*/
+#ifdef FLASH_SIM
+
+// header files used
+#include "Flash.h"
+#include "Cpu.h"
+
+//number of sectors in the simulated Flash
+#define SIM_NB_SECTORS (FLASH_SIM_SIZE / FLASH_SECTOR_SIZE)
+//each FPROT bit protects 1/32 of the Flash
+#define SIM_PROT_REGION_SIZE (FLASH_SIM_SIZE / 32)
+//Program Section programs in units of 128 bits
+#define SIM_SECTION_UNIT_SIZE 16
+//core clock cycles in a microsecond, to advance the DWT cycle counter
+#define SIM_CYCLES_PER_US (CPU_CORE_CLK_HZ / 1000000)
+
+volatile struct FTFE_MemMap FlashSim_FTFE;
+volatile struct NVIC_MemMap FlashSim_NVIC;
+volatile struct DWT_MemMap FlashSim_DWT;
+volatile struct CoreDebug_MemMap FlashSim_CoreDebug;
+
+//the program Flash and FlexRAM
+static uint8_t Memory[FLASH_SIM_SIZE];
+static uint8_t FlexRAM[FLASH_FLEXRAM_SIZE];
+//number of erases of each sector
+static uint32_t EraseCount[SIM_NB_SECTORS];
+//number of erases after which a sector fails erase verify, 0 for no limit
+static uint32_t Endurance;
+//time taken by each command in microseconds, indexed by the command code
+static uint32_t Latency[256];
+//simulated time in microseconds
+static uint64_t Now;
+//state of the swap system, as returned by the Swap Control command
+static TFlashSwapMode SwapMode;
+
+//the command in progress, with the register values it was launched with
+static bool Busy;
+static uint64_t CompleteTime;
+static uint8_t Command;
+static uint32_t Address;
+static uint8_t Data[8];
+//error flags to report when the command completes
+static uint8_t Errors;
+
+/*************************function prototypes***************************/
+static bool Protected(const uint32_t address);
+
+static uint8_t CheckCommand(uint32_t* const latency);
+
+static void Complete(void);
+/***********************************************************************/
+
+void FlashSim_Init(void)
+{
+  for (uint32_t i = 0; i < FLASH_SIM_SIZE; i++)
+    Memory[i] = 0xFF;
+  for (uint32_t i = 0; i < FLASH_FLEXRAM_SIZE; i++)
+    FlexRAM[i] = 0xFF;
+  for (uint32_t i = 0; i < SIM_NB_SECTORS; i++)
+    EraseCount[i] = 0;
+
+  //idle, with the FlexRAM available as RAM and no region protected
+  FlashSim_FTFE.FSTAT = FTFE_FSTAT_CCIF_MASK;
+  FlashSim_FTFE.FCNFG = FTFE_FCNFG_RAMRDY_MASK;
+  FlashSim_FTFE.FPROT0 = 0xFF;
+  FlashSim_FTFE.FPROT1 = 0xFF;
+  FlashSim_FTFE.FPROT2 = 0xFF;
+  FlashSim_FTFE.FPROT3 = 0xFF;
+  FlashSim_DWT.CYCCNT = 0;
+
+  //typical command times
+  for (uint16_t i = 0; i < 256; i++)
+    Latency[i] = 0;
+  Latency[0x01] = 1;
+  Latency[0x02] = 5;
+  Latency[0x07] = 50;
+  Latency[0x09] = 13000;
+  Latency[0x0B] = 78;
+  Latency[0x46] = 100;
+
+  Endurance = 0;
+  Now = 0;
+  Busy = FALSE;
+  SwapMode = FLASH_SWAP_UNINITIALIZED;
+}
+
+
+void FlashSim_Reset(void)
+{
+  uint8_t temp;
+
+  if (SwapMode == FLASH_SWAP_COMPLETE)
+    {
+      for (uint32_t i = 0; i < FLASH_HALF_SIZE; i++)
+	{
+	  temp = Memory[i];
+	  Memory[i] = Memory[FLASH_HALF_SIZE + i];
+	  Memory[FLASH_HALF_SIZE + i] = temp;
+	}
+      SwapMode = FLASH_SWAP_READY;
+    }
+
+  Busy = FALSE;
+  FlashSim_FTFE.FSTAT = FTFE_FSTAT_CCIF_MASK;
+  FlashSim_FTFE.FCNFG = FTFE_FCNFG_RAMRDY_MASK;
+}
+
+
+void FlashSim_SetLatency(const uint8_t command, const uint32_t microseconds)
+{
+  Latency[command] = microseconds;
+}
+
+
+void FlashSim_SetEndurance(const uint32_t cycles)
+{
+  Endurance = cycles;
+}
+
+
+void FlashSim_Launch(void)
+{
+  uint32_t latency = 0;
+
+  //a launch while busy is ignored, as the FTFE ignores writes to CCIF while a command runs
+  if (Busy)
+    return;
+
+  Command = FlashSim_FTFE.FCCOB0;
+  Address = ((uint32_t)FlashSim_FTFE.FCCOB1 << 16) | ((uint32_t)FlashSim_FTFE.FCCOB2 << 8) | FlashSim_FTFE.FCCOB3;
+  Data[0] = FlashSim_FTFE.FCCOB7;
+  Data[1] = FlashSim_FTFE.FCCOB6;
+  Data[2] = FlashSim_FTFE.FCCOB5;
+  Data[3] = FlashSim_FTFE.FCCOB4;
+  Data[4] = FlashSim_FTFE.FCCOBB;
+  Data[5] = FlashSim_FTFE.FCCOBA;
+  Data[6] = FlashSim_FTFE.FCCOB9;
+  Data[7] = FlashSim_FTFE.FCCOB8;
+
+  //invalid commands are rejected straight away
+  Errors = CheckCommand(&latency);
+
+  Busy = TRUE;
+  CompleteTime = Now + (Errors ? 0 : latency);
+  FlashSim_FTFE.FSTAT = 0;
+}
+
+
+void FlashSim_Advance(const uint32_t microseconds)
+{
+  uint64_t end = Now + microseconds;
+
+  if (Busy && CompleteTime <= end)
+    {
+      FlashSim_DWT.CYCCNT += (uint32_t)(CompleteTime - Now) * SIM_CYCLES_PER_US;
+      Now = CompleteTime;
+      Complete();
+
+      //the ISR may launch another command, which takes part of the remaining time
+      FlashSim_Advance((uint32_t)(end - Now));
+      return;
+    }
+
+  FlashSim_DWT.CYCCNT += microseconds * SIM_CYCLES_PER_US;
+  Now = end;
+}
+
+
+void FlashSim_Finish(void)
+{
+  if (Busy)
+    FlashSim_Advance((uint32_t)(CompleteTime - Now));
+}
+
+
+bool FlashSim_Busy(void)
+{
+  return Busy;
+}
+
+
+uint64_t FlashSim_Time(void)
+{
+  return Now;
+}
+
+
+uint32_t FlashSim_EraseCount(const uint32_t address)
+{
+  if (address >= FLASH_SIM_SIZE)
+    return 0;
+
+  return EraseCount[address / FLASH_SECTOR_SIZE];
+}
+
+
+void FlashSim_Protect(const uint32_t address, const bool protect)
+{
+  uint8_t region = address / SIM_PROT_REGION_SIZE;
+  volatile uint8_t* fprot;
+
+  if (address >= FLASH_SIM_SIZE)
+    return;
+
+  //FPROT3 bit 0 protects the lowest region and FPROT0 bit 7 the highest
+  fprot = (region < 8) ? &FlashSim_FTFE.FPROT3 : (region < 16) ? &FlashSim_FTFE.FPROT2 :
+	  (region < 24) ? &FlashSim_FTFE.FPROT1 : &FlashSim_FTFE.FPROT0;
+
+  //a cleared bit protects the region
+  if (protect)
+    *fprot &= ~(1 << (region % 8));
+  else
+    *fprot |= 1 << (region % 8);
+}
+
+
+volatile uint8_t* FlashSim_Address(const uint32_t address)
+{
+  if (address < FLASH_SIM_SIZE)
+    return &Memory[address];
+  if (address >= FLASH_FLEXRAM_START && address < FLASH_FLEXRAM_START + FLASH_FLEXRAM_SIZE)
+    return &FlexRAM[address - FLASH_FLEXRAM_START];
+
+  return NULL;
+}
+
+/*! @brief Checks whether an address is in a protected region.
+ *
+ *  @param address The address to check.
+ *  @return bool - TRUE if the region is protected.
+ */
+static bool Protected(const uint32_t address)
+{
+  uint8_t region = address / SIM_PROT_REGION_SIZE;
+  uint32_t fprot = ((uint32_t)FlashSim_FTFE.FPROT0 << 24) | ((uint32_t)FlashSim_FTFE.FPROT1 << 16) |
+		   ((uint32_t)FlashSim_FTFE.FPROT2 << 8) | FlashSim_FTFE.FPROT3;
+
+  return !(fprot & (1LU << region));
+}
+
+/*! @brief Checks the launched command the way the FTFE does.
+ *
+ *  @param latency Set to the time the command will take.
+ *  @return uint8_t - The FSTAT error flags for the command, 0 if it is valid.
+ */
+static uint8_t CheckCommand(uint32_t* const latency)
+{
+  uint16_t units;
+
+  switch (Command)
+  {
+    case 0x01: //Read 1s Section, with the number of units in FCCOB4 and FCCOB5
+      units = ((uint16_t)Data[3] << 8) | Data[2];
+      if (Address >= FLASH_SIM_SIZE || (Address % SIM_SECTION_UNIT_SIZE) || units == 0 ||
+	  (Address % FLASH_SECTOR_SIZE) + units * SIM_SECTION_UNIT_SIZE > FLASH_SECTOR_SIZE)
+	return FTFE_FSTAT_ACCERR_MASK;
+      *latency = Latency[Command] * units;
+      return 0;
+
+    case 0x02: //Program Check
+      if (Address >= FLASH_SIM_SIZE || (Address % 4))
+	return FTFE_FSTAT_ACCERR_MASK;
+      *latency = Latency[Command];
+      return 0;
+
+    case 0x07: //Program Phrase
+      if (Address >= FLASH_SIM_SIZE || (Address % 8))
+	return FTFE_FSTAT_ACCERR_MASK;
+      *latency = Latency[Command];
+      break;
+
+    case 0x09: //Erase Sector
+      if (Address >= FLASH_SIM_SIZE || (Address % FLASH_SECTOR_SIZE))
+	return FTFE_FSTAT_ACCERR_MASK;
+      *latency = Latency[Command];
+      break;
+
+    case 0x0B: //Program Section, with the number of units in FCCOB4 and FCCOB5
+      units = ((uint16_t)Data[3] << 8) | Data[2];
+      if (Address >= FLASH_SIM_SIZE || (Address % SIM_SECTION_UNIT_SIZE) || units == 0 ||
+	  units * SIM_SECTION_UNIT_SIZE > FLASH_FLEXRAM_SIZE ||
+	  (Address % FLASH_SECTOR_SIZE) + units * SIM_SECTION_UNIT_SIZE > FLASH_SECTOR_SIZE ||
+	  !(FlashSim_FTFE.FCNFG & FTFE_FCNFG_RAMRDY_MASK))
+	return FTFE_FSTAT_ACCERR_MASK;
+      *latency = Latency[Command] * units;
+      break;
+
+    case 0x46: //Swap Control, with the control code in FCCOB4
+      if (Address != FLASH_SWAP_INDICATOR)
+	return FTFE_FSTAT_ACCERR_MASK;
+      if ((Data[3] == FLASH_SWAP_INITIALIZE && SwapMode != FLASH_SWAP_UNINITIALIZED) ||
+	  (Data[3] == FLASH_SWAP_SET_UPDATE && SwapMode != FLASH_SWAP_READY) ||
+	  (Data[3] == FLASH_SWAP_SET_COMPLETE && SwapMode != FLASH_SWAP_UPDATE_ERASED))
+	return FTFE_FSTAT_ACCERR_MASK;
+      if (Data[3] != FLASH_SWAP_INITIALIZE && Data[3] != FLASH_SWAP_SET_UPDATE &&
+	  Data[3] != FLASH_SWAP_SET_COMPLETE && Data[3] != FLASH_SWAP_REPORT)
+	return FTFE_FSTAT_ACCERR_MASK;
+      *latency = Latency[Command];
+      return 0;
+
+    default:
+      return FTFE_FSTAT_ACCERR_MASK;
+  }
+
+  if (Protected(Address))
+    return FTFE_FSTAT_FPVIOL_MASK;
+
+  return 0;
+}
+
+/*! @brief Applies the command in progress to the memory and reports it complete.
+ */
+static void Complete(void)
+{
+  uint8_t status = Errors;
+  uint32_t sector = Address / FLASH_SECTOR_SIZE;
+
+  if (!Errors)
+    switch (Command)
+    {
+      case 0x01:
+	//the margin read fails if any bit is programmed
+	for (uint32_t i = 0; i < ((uint32_t)Data[3] << 8 | Data[2]) * SIM_SECTION_UNIT_SIZE; i++)
+	  if (Memory[Address + i] != 0xFF)
+	    status = FTFE_FSTAT_MGSTAT0_MASK;
+	break;
+
+      case 0x02:
+	//the expected data is in FCCOB8 to FCCOBB, with the byte at the lowest address in FCCOBB
+	for (uint8_t i = 0; i < 4; i++)
+	  if (Memory[Address + i] != Data[4 + i])
+	    status = FTFE_FSTAT_MGSTAT0_MASK;
+	break;
+
+      case 0x07:
+	//programming can only clear bits
+	for (uint8_t i = 0; i < 8; i++)
+	  Memory[Address + i] &= Data[i];
+	break;
+
+      case 0x09:
+	EraseCount[sector]++;
+	//a worn out sector fails erase verify and leaves some bits programmed
+	if (Endurance && EraseCount[sector] > Endurance)
+	  status = FTFE_FSTAT_MGSTAT0_MASK;
+	for (uint32_t i = 0; i < FLASH_SECTOR_SIZE; i++)
+	  Memory[sector * FLASH_SECTOR_SIZE + i] = (status && (i % 64) == 0) ? 0xFE : 0xFF;
+	//erasing the swap indicator in the upper half is the next step of an update
+	if (SwapMode == FLASH_SWAP_UPDATE && sector * FLASH_SECTOR_SIZE == FLASH_HALF_SIZE + FLASH_SWAP_INDICATOR)
+	  SwapMode = FLASH_SWAP_UPDATE_ERASED;
+	break;
+
+      case 0x46:
+	if (Data[3] == FLASH_SWAP_INITIALIZE)
+	  SwapMode = FLASH_SWAP_READY;
+	else if (Data[3] == FLASH_SWAP_SET_UPDATE)
+	  SwapMode = FLASH_SWAP_UPDATE;
+	else if (Data[3] == FLASH_SWAP_SET_COMPLETE)
+	  SwapMode = FLASH_SWAP_COMPLETE;
+	FlashSim_FTFE.FCCOB5 = SwapMode;
+	break;
+
+      case 0x0B:
+	for (uint32_t i = 0; i < ((uint32_t)Data[3] << 8 | Data[2]) * SIM_SECTION_UNIT_SIZE; i++)
+	  Memory[Address + i] &= FlexRAM[i];
+	break;
+    }
+
+  Busy = FALSE;
+  FlashSim_FTFE.FSTAT = FTFE_FSTAT_CCIF_MASK | status;
+
+  if (FlashSim_FTFE.FCNFG & FTFE_FCNFG_CCIE_MASK)
+    Flash_ISR();
+}
+
+#endif
+
+/*!
+** @}
+*/
@@ -0,0 +1,135 @@
+/*! @file
+ *
+ *  @brief Simulation of the FTFE and program Flash for building the Flash module on a host PC.
+ *
+ *  When FLASH_SIM is defined, Flash.h includes this file instead of accessing the hardware.
+ *  The FTFE, NVIC, DWT and debug registers used by flash.c are replaced by variables, and Flash
+ *  addresses are mapped onto an array. Erased Flash reads as 0xFF, programming can only clear bits,
+ *  commands take a configurable time and errors are reported in ACCERR, FPVIOL and MGSTAT0.
+ *  The RTOS only runs on the tower, so the host build in the Host folder uses its own OS.h in place of the one in Library.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-24
+ */
+/*!
+**  @addtogroup FlashSim_module FlashSim module documentation
+**  @{
+*/
+#ifndef FLASHSIM_H
+#define FLASHSIM_H
+
+// new types
+#include "types.h"
+#include "MK70F12.h"
+
+// Size of the simulated program Flash
+#define FLASH_SIM_SIZE 0x00100000LU
+
+// FLASH data access, mapped onto the simulated memory
+#define _FB(flashAddress)  *(uint8_t  volatile *)FlashSim_Address(flashAddress)
+#define _FH(flashAddress)  *(uint16_t volatile *)FlashSim_Address(flashAddress)
+#define _FW(flashAddress)  *(uint32_t volatile *)FlashSim_Address(flashAddress)
+#define _FP(flashAddress)  *(uint64_t volatile *)FlashSim_Address(flashAddress)
+
+// The registers used by the Flash module are variables on the host
+#undef FTFE_BASE_PTR
+#define FTFE_BASE_PTR (&FlashSim_FTFE)
+#undef NVIC_BASE_PTR
+#define NVIC_BASE_PTR (&FlashSim_NVIC)
+#undef DWT_BASE_PTR
+#define DWT_BASE_PTR (&FlashSim_DWT)
+#undef CoreDebug_BASE_PTR
+#define CoreDebug_BASE_PTR (&FlashSim_CoreDebug)
+
+// The Flash ISR is called as an ordinary function on the host
+#define interrupt
+
+extern volatile struct FTFE_MemMap FlashSim_FTFE;
+extern volatile struct NVIC_MemMap FlashSim_NVIC;
+extern volatile struct DWT_MemMap FlashSim_DWT;
+extern volatile struct CoreDebug_MemMap FlashSim_CoreDebug;
+
+/*! @brief Resets the simulation.
+ *
+ *  Every byte of Flash and FlexRAM is erased, the FTFE is idle with no protection, erase counts are cleared
+ *  and the command latencies are set to typical values.
+ */
+void FlashSim_Init(void);
+
+/*! @brief Simulates a reset of the tower.
+ *
+ *  If the swap system is in the complete state, the two halves of the Flash swap places and it becomes ready again.
+ *  Any command in progress is abandoned.
+ */
+void FlashSim_Reset(void);
+
+/*! @brief Sets how long a command takes.
+ *
+ *  @param command The FTFE command code, e.g. 0x09 for Erase Sector.
+ *  @param microseconds The time the command takes. For Program Section this is the time per 128-bit unit.
+ */
+void FlashSim_SetLatency(const uint8_t command, const uint32_t microseconds);
+
+/*! @brief Sets how many times a sector can be erased before its erase verify fails.
+ *
+ *  @param cycles The number of successful erases per sector, or 0 for no limit.
+ */
+void FlashSim_SetEndurance(const uint32_t cycles);
+
+/*! @brief Called by the Flash module after it writes CCIF to launch a command.
+ *
+ *  The registers are plain variables, so the simulation cannot see the write itself.
+ *  Invalid commands complete at once with ACCERR or FPVIOL set.
+ */
+void FlashSim_Launch(void);
+
+/*! @brief Moves the simulated time forward.
+ *
+ *  Completes the command in progress when its time is up and calls Flash_ISR if the command complete interrupt is enabled.
+ *  The DWT cycle counter advances with the simulated time.
+ *  @param microseconds The time to move forward.
+ */
+void FlashSim_Advance(const uint32_t microseconds);
+
+/*! @brief Moves the simulated time forward until the command in progress has completed.
+ */
+void FlashSim_Finish(void);
+
+/*! @brief Checks whether a command is in progress.
+ *
+ *  @return bool - TRUE if the FTFE is executing a command.
+ */
+bool FlashSim_Busy(void);
+
+/*! @brief Gets the simulated time.
+ *
+ *  @return uint64_t - The number of microseconds since FlashSim_Init.
+ */
+uint64_t FlashSim_Time(void);
+
+/*! @brief Gets the number of times a sector has been erased.
+ *
+ *  @param address Any address in the sector.
+ *  @return uint32_t - The number of Erase Sector commands that have completed on the sector.
+ */
+uint32_t FlashSim_EraseCount(const uint32_t address);
+
+/*! @brief Protects or unprotects a 32 KB region of the Flash, as FPROT does.
+ *
+ *  @param address Any address in the region.
+ *  @param protect TRUE to protect the region from erasing and programming.
+ */
+void FlashSim_Protect(const uint32_t address, const bool protect);
+
+/*! @brief Maps a Flash or FlexRAM address onto the simulated memory.
+ *
+ *  @param address The address on the tower.
+ *  @return volatile uint8_t* - The host address of the simulated byte, or NULL if the address is not simulated.
+ */
+volatile uint8_t* FlashSim_Address(const uint32_t address);
+
+#endif
+
+/*!
+** @}
+*/
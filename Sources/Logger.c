@@ -0,0 +1,621 @@
+/*! @file
+ *
+ *  @brief Routines for logging analog samples to Flash.
+ *
+ *  This contains the functions for recording timestamped samples in a ring of Flash sectors,
+ *  so they are kept while the PC is not connected and can be uploaded later.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-22
+ */
+/*!
+**  @addtogroup Logger_module Logger module documentation
+**  @{
+*/
+// header files used
+#include "Logger.h"
+#include "Flash.h"
+#include "RTC.h"
+#include "PE_Types.h"
+#include "OS.h"
+#include "ThreadManage.h"
+
+//identifies a log sector header
+#define LOG_MAGIC 0x4C4F4731LU
+//bytes at the start of each sector reserved for its header
+#define LOG_HEADER_SIZE 32
+//offsets of the header phrases within a sector
+#define LOG_OPEN_OFFSET  0x00
+#define LOG_FIRST_OFFSET 0x08
+#define LOG_CLOSE_OFFSET 0x10
+//number of records that fit in a sector after its header
+#define LOG_RECORDS_PER_SECTOR ((FLASH_SECTOR_SIZE - LOG_HEADER_SIZE) / sizeof(TLogRecord))
+//number of records written to Flash at once
+#define LOG_BATCH_SIZE 32
+//Program Section programs in units of 128 bits, two records
+#define LOG_UNIT_SIZE 16
+//times a run of records is written, each in a fresh sector, before it is dropped
+#define LOG_WRITE_ATTEMPTS 2
+
+/*!
+ * Each sector starts with a header of four phrases:
+ * the open phrase and first time are written when the sector is started,
+ * the close phrase when the next sector is started, and the last phrase is left erased.
+ */
+typedef union
+{
+  uint64_t phrase;
+  struct
+  {
+    uint32_t magic;    /*!< LOG_MAGIC once the sector is in use. */
+    uint32_t sequence; /*!< Incremented for each new sector, the newest sector has the highest. */
+  } open;
+  struct
+  {
+    uint32_t seconds;  /*!< The time of the first record in the sector. */
+    uint32_t reserved; /*!< Left erased. */
+  } first;
+  struct
+  {
+    uint32_t seconds;  /*!< The time of the last record in the sector. */
+    uint32_t count;    /*!< The number of records in the sector. */
+  } close;
+} TLogHeader;
+
+typedef struct
+{
+  uint32_t first;      /*!< The time of the first record in the sector. */
+  uint32_t last;       /*!< The time of the last record in the sector. */
+  uint16_t count;      /*!< The number of records in the sector, less than LOG_RECORDS_PER_SECTOR if a write failed. */
+} TLogSpan;
+
+typedef struct
+{
+  TLogRecord records[LOG_BATCH_SIZE]; /*!< The samples waiting to be written. */
+  uint8_t count;                      /*!< The number of samples in the batch. */
+  volatile bool full;                 /*!< TRUE from the time the batch is handed to the logger thread until it has been written. */
+} TLogBatch;
+
+//double-buffered RAM staging for samples, filled by Logger_Append and emptied by the logger thread
+static TLogBatch Batch[2];
+static uint8_t FillBatch, FlushBatch;
+//number of samples dropped because both batches were waiting to be written, or because Flash could not be written
+static uint32_t Overruns, WriteFailures;
+
+static volatile bool Enabled;
+//whether logging was enabled when Logger_Lock paused it
+static bool ResumeEnabled;
+
+//the ring: the sector slot being written, the oldest slot, the number of slots in use and the next record in the head slot
+static uint8_t HeadSlot, OldestSlot, SlotsUsed;
+static uint16_t HeadRecord;
+static uint32_t HeadSequence;
+//the number of records in all the sectors of the ring
+static uint32_t Records;
+//in RAM index of the time span of each sector slot, used to search the log by time
+static TLogSpan Span[FLASH_LOG_NB_SECTORS];
+
+//stack for thread
+OS_THREAD_STACK(LoggerStack, THREAD_STACK_SIZE);
+//semaphore signalled when a batch is ready to be written
+static OS_ECB* BatchReady;
+//held by the logger thread while it moves the ring on, and by readers of the ring, so they never see it half updated
+static OS_ECB* LogMutex;
+
+/*************************function prototypes***************************/
+static void LoggerThread(void* arg);
+
+static bool StartSector(const uint8_t slot, const uint32_t seconds);
+
+static uint16_t SectorEnd(const uint8_t slot);
+
+static bool LocateRecord(const uint32_t index, uint8_t* const slot, uint16_t* const recordNb);
+
+static uint32_t RecordSeconds(const uint8_t slot, const uint16_t recordNb);
+
+static bool WriteBatch(TLogBatch* const batch);
+
+static bool WriteRecords(const uint32_t address, const TLogRecord* const records, const uint16_t count);
+
+static uint64_t RecordPhrase(const TLogRecord* const record);
+
+static uint32_t SlotAddress(const uint8_t slot);
+/***********************************************************************/
+
+bool Logger_Init(void)
+{
+  TLogHeader header;
+  bool found = FALSE;
+
+  Enabled = FALSE;
+  Overruns = 0;
+  WriteFailures = 0;
+  FillBatch = 0;
+  FlushBatch = 0;
+  for (uint8_t i = 0; i < 2; i++)
+    {
+      Batch[i].count = 0;
+      Batch[i].full = FALSE;
+    }
+
+  //rebuild the extent of the ring and the time index from the sector headers alone
+  SlotsUsed = 0;
+  Records = 0;
+  for (uint8_t slot = 0; slot < FLASH_LOG_NB_SECTORS; slot++)
+    {
+      header.phrase = _FP(SlotAddress(slot) + LOG_OPEN_OFFSET);
+      if (header.open.magic != LOG_MAGIC)
+	continue;
+
+      SlotsUsed++;
+      if (!found || (int32_t)(header.open.sequence - HeadSequence) > 0)
+	{
+	  HeadSlot = slot;
+	  HeadSequence = header.open.sequence;
+	}
+      found = TRUE;
+
+      header.phrase = _FP(SlotAddress(slot) + LOG_FIRST_OFFSET);
+      Span[slot].first = header.first.seconds;
+
+      //a sector that was never closed ends at its first erased record
+      header.phrase = _FP(SlotAddress(slot) + LOG_CLOSE_OFFSET);
+      if (header.phrase != 0xFFFFFFFFFFFFFFFFULL && header.close.count <= LOG_RECORDS_PER_SECTOR)
+	{
+	  Span[slot].last = header.close.seconds;
+	  Span[slot].count = (uint16_t)header.close.count;
+	}
+      else
+	{
+	  Span[slot].count = SectorEnd(slot);
+	  Span[slot].last = Span[slot].count ? RecordSeconds(slot, Span[slot].count - 1) : Span[slot].first;
+	}
+      Records += Span[slot].count;
+    }
+
+  if (found)
+    {
+      //the sectors are used in order, so the oldest is the one the head will reach last
+      OldestSlot = (HeadSlot + FLASH_LOG_NB_SECTORS + 1 - SlotsUsed) % FLASH_LOG_NB_SECTORS;
+
+      //records are written in order, so the log continues from the first erased one, unless the head was closed early
+      if (_FP(SlotAddress(HeadSlot) + LOG_CLOSE_OFFSET) == 0xFFFFFFFFFFFFFFFFULL)
+	HeadRecord = Span[HeadSlot].count;
+      else
+	HeadRecord = LOG_RECORDS_PER_SECTOR;
+    }
+  else
+    {
+      HeadSlot = FLASH_LOG_NB_SECTORS - 1;
+      OldestSlot = 0;
+      HeadSequence = 0;
+      HeadRecord = LOG_RECORDS_PER_SECTOR; //the first batch will start a new sector
+    }
+
+  BatchReady = OS_SemaphoreCreate(0);
+  LogMutex = OS_SemaphoreCreate(1);
+  OS_ThreadCreate(LoggerThread, NULL, &LoggerStack[THREAD_STACK_SIZE - 1], LOGGER_THREAD);
+
+  return TRUE;
+}
+
+
+void Logger_Enable(const bool enable)
+{
+  TLogBatch* batch;
+
+  if (!enable && Enabled)
+    {
+      Enabled = FALSE;
+
+      //hand over a partly filled batch
+      OS_DisableInterrupts();
+      batch = &Batch[FillBatch];
+      if (!batch->full && batch->count)
+	{
+	  batch->full = TRUE;
+	  FillBatch = 1 - FillBatch;
+	  OS_EnableInterrupts();
+	  (void)OS_SemaphoreSignal(BatchReady);
+	}
+      else
+	OS_EnableInterrupts();
+    }
+  else
+    Enabled = enable;
+}
+
+
+bool Logger_IsEnabled(void)
+{
+  return Enabled;
+}
+
+
+uint32_t Logger_Lost(void)
+{
+  return Overruns + WriteFailures;
+}
+
+
+bool Logger_Append(const uint8_t channelNb, const int16_t value)
+{
+  TLogBatch* const batch = &Batch[FillBatch];
+  TLogRecord* record;
+  uint32_t seconds;
+  uint16_t prescaler;
+
+  if (!Enabled)
+    return FALSE;
+
+  //both batches are waiting for Flash, drop the sample rather than hold up acquisition
+  if (batch->full)
+    {
+      Overruns++;
+      return FALSE;
+    }
+
+  RTC_GetCounter(&seconds, &prescaler);
+
+  record = &batch->records[batch->count];
+  record->seconds = seconds;
+  record->fraction = ((prescaler >> 3) << 4) | (channelNb & 0x0F);
+  record->value = value;
+  batch->count++;
+
+  if (batch->count == LOG_BATCH_SIZE)
+    {
+      batch->full = TRUE;
+      FillBatch = 1 - FillBatch;
+      (void)OS_SemaphoreSignal(BatchReady);
+    }
+
+  return TRUE;
+}
+
+
+uint32_t Logger_Count(void)
+{
+  uint32_t count;
+
+  (void)OS_SemaphoreWait(LogMutex, 0);
+  count = Records;
+  (void)OS_SemaphoreSignal(LogMutex);
+
+  return count;
+}
+
+
+bool Logger_Find(const uint32_t seconds, uint32_t* const index)
+{
+  uint32_t low, high, middle;
+  uint8_t slot;
+
+  (void)OS_SemaphoreWait(LogMutex, 0);
+
+  //binary search for the first sector, oldest first, whose last record is not before the time
+  low = 0;
+  high = SlotsUsed;
+  while (low < high)
+    {
+      middle = (low + high) / 2;
+      if ((int32_t)(Span[(OldestSlot + middle) % FLASH_LOG_NB_SECTORS].last - seconds) < 0)
+	low = middle + 1;
+      else
+	high = middle;
+    }
+
+  if (low == SlotsUsed)
+    {
+      *index = Records;
+      (void)OS_SemaphoreSignal(LogMutex);
+      return FALSE;
+    }
+
+  //sectors closed after a failed write hold fewer records, so the ones before are counted
+  *index = 0;
+  for (uint32_t i = 0; i < low; i++)
+    *index += Span[(OldestSlot + i) % FLASH_LOG_NB_SECTORS].count;
+  slot = (OldestSlot + low) % FLASH_LOG_NB_SECTORS;
+
+  //then for the first record in that sector that is not before the time
+  high = Span[slot].count;
+  low = 0;
+  while (low < high)
+    {
+      middle = (low + high) / 2;
+      if ((int32_t)(RecordSeconds(slot, middle) - seconds) < 0)
+	low = middle + 1;
+      else
+	high = middle;
+    }
+
+  *index += low;
+
+  (void)OS_SemaphoreSignal(LogMutex);
+  return TRUE;
+}
+
+
+bool Logger_Get(const uint32_t index, TLogRecord* const record)
+{
+  uint8_t slot;
+  uint16_t recordNb;
+  bool exists;
+
+  //the sector cannot be erased while it is being read
+  (void)OS_SemaphoreWait(LogMutex, 0);
+
+  exists = LocateRecord(index, &slot, &recordNb);
+  if (exists)
+    *record = *(TLogRecord*)(SlotAddress(slot) + LOG_HEADER_SIZE + recordNb * sizeof(TLogRecord));
+
+  (void)OS_SemaphoreSignal(LogMutex);
+  return exists;
+}
+
+void Logger_Lock(void)
+{
+  ResumeEnabled = Enabled;
+  Logger_Enable(FALSE);
+
+  //the logger thread empties both batches before the log is frozen
+  while (Batch[0].full || Batch[1].full)
+    OS_TimeDelay(1);
+
+  (void)OS_SemaphoreWait(LogMutex, 0);
+}
+
+
+void Logger_Unlock(void)
+{
+  (void)OS_SemaphoreSignal(LogMutex);
+  Logger_Enable(ResumeEnabled);
+}
+
+/*! @brief Writes each batch handed over by Logger_Append to Flash.
+ *
+ *  @param arg Unused.
+ */
+static void LoggerThread(void* arg)
+{
+  for (;;)
+    {
+      (void)OS_SemaphoreWait(BatchReady, 0);
+
+      //readers wait while sectors are erased and the head moves on
+      (void)OS_SemaphoreWait(LogMutex, 0);
+      (void)WriteBatch(&Batch[FlushBatch]);
+      (void)OS_SemaphoreSignal(LogMutex);
+
+      Batch[FlushBatch].count = 0;
+      Batch[FlushBatch].full = FALSE;
+      FlushBatch = 1 - FlushBatch;
+    }
+}
+
+/*! @brief Closes the head sector, then erases a sector slot and makes it the new head of the ring.
+ *
+ *  If the ring is full, the oldest sector is overwritten.
+ *  @param slot The sector slot to start.
+ *  @param seconds The time of the first record that will be written to the sector.
+ *  @return bool - TRUE if the sector was erased and its header written.
+ *  @note Assumes the caller holds LogMutex.
+ */
+static bool StartSector(const uint8_t slot, const uint32_t seconds)
+{
+  TLogHeader header;
+
+  //record the time span of the sector being left, so it can be indexed without reading its records
+  if (SlotsUsed && _FP(SlotAddress(HeadSlot) + LOG_CLOSE_OFFSET) == 0xFFFFFFFFFFFFFFFFULL)
+    {
+      header.close.seconds = Span[HeadSlot].last;
+      header.close.count = Span[HeadSlot].count;
+      (void)Flash_WritePhrase(SlotAddress(HeadSlot) + LOG_CLOSE_OFFSET, header.phrase);
+    }
+
+  //the oldest sector is about to be erased, so it leaves the ring first
+  if (SlotsUsed == FLASH_LOG_NB_SECTORS)
+    {
+      Records -= Span[OldestSlot].count;
+      OldestSlot = (OldestSlot + 1) % FLASH_LOG_NB_SECTORS;
+      SlotsUsed--;
+    }
+
+  if (!Flash_EraseSector(SlotAddress(slot)))
+    return FALSE;
+
+  header.first.seconds = seconds;
+  header.first.reserved = 0xFFFFFFFF;
+  if (!Flash_WritePhrase(SlotAddress(slot) + LOG_FIRST_OFFSET, header.phrase))
+    return FALSE;
+
+  //the sector becomes part of the ring once its open phrase is written
+  header.open.magic = LOG_MAGIC;
+  header.open.sequence = HeadSequence + 1;
+  if (!Flash_WritePhrase(SlotAddress(slot) + LOG_OPEN_OFFSET, header.phrase))
+    return FALSE;
+
+  if (!SlotsUsed)
+    OldestSlot = slot;
+
+  HeadSlot = slot;
+  HeadSequence++;
+  HeadRecord = 0;
+  SlotsUsed++;
+  Span[slot].first = seconds;
+  Span[slot].last = seconds;
+  Span[slot].count = 0;
+
+  return TRUE;
+}
+
+/*! @brief Writes a batch of records at the head of the ring, starting new sectors as needed.
+ *
+ *  If a write or its check fails, the records around it cannot be trusted, so the head sector is closed
+ *  with the records written so far and the run is written again in a new sector.
+ *  @param batch The batch to write.
+ *  @return bool - TRUE if all the records were written, FALSE if some were dropped.
+ *  @note Assumes the caller holds LogMutex.
+ */
+static bool WriteBatch(TLogBatch* const batch)
+{
+  uint8_t done = 0, attempts = 0;
+  bool complete = TRUE;
+
+  while (done < batch->count)
+    {
+      uint8_t chunk = batch->count - done;
+
+      if (HeadRecord == LOG_RECORDS_PER_SECTOR && !StartSector((HeadSlot + 1) % FLASH_LOG_NB_SECTORS, batch->records[done].seconds))
+	{
+	  WriteFailures += batch->count - done;
+	  return FALSE;
+	}
+
+      if (chunk > LOG_RECORDS_PER_SECTOR - HeadRecord)
+	chunk = LOG_RECORDS_PER_SECTOR - HeadRecord;
+
+      if (!WriteRecords(SlotAddress(HeadSlot) + LOG_HEADER_SIZE + HeadRecord * sizeof(TLogRecord), &batch->records[done], chunk))
+	{
+	  //StartSector closes the head with the count in its span, which leaves out the failed records
+	  HeadRecord = LOG_RECORDS_PER_SECTOR;
+	  if (++attempts < LOG_WRITE_ATTEMPTS)
+	    continue;
+
+	  WriteFailures += chunk;
+	  complete = FALSE;
+	  done += chunk;
+	  attempts = 0;
+	  continue;
+	}
+
+      HeadRecord += chunk;
+      Span[HeadSlot].count += chunk;
+      Records += chunk;
+      done += chunk;
+      attempts = 0;
+      Span[HeadSlot].last = batch->records[done - 1].seconds;
+    }
+
+  return complete;
+}
+
+/*! @brief Writes records to erased Flash.
+ *
+ *  Whole 128-bit units are written with Program Section. A record that starts half way through a unit,
+ *  or is left over at the end, is written on its own with Program Phrase, so no filler record is ever logged.
+ *  @param address The address of the first record, aligned to an 8-byte boundary.
+ *  @param records The records.
+ *  @param count The number of records.
+ *  @return bool - TRUE if all the records were written.
+ */
+static bool WriteRecords(const uint32_t address, const TLogRecord* const records, const uint16_t count)
+{
+  uint16_t done = 0, units;
+
+  if ((address % LOG_UNIT_SIZE) && count)
+    {
+      if (!Flash_WritePhrase(address, RecordPhrase(&records[0])))
+	return FALSE;
+      done = 1;
+    }
+
+  units = (count - done) / 2;
+  if (units && !Flash_WriteSection(address + done * sizeof(TLogRecord), (const uint8_t*)&records[done], units * LOG_UNIT_SIZE))
+    return FALSE;
+  done += units * 2;
+
+  if (done < count)
+    return Flash_WritePhrase(address + done * sizeof(TLogRecord), RecordPhrase(&records[done]));
+
+  return TRUE;
+}
+
+/*! @brief Packs a record into the phrase it occupies in Flash.
+ *
+ *  The records are packed, so they may not be aligned for a 64-bit read.
+ *  @param record The record.
+ *  @return uint64_t - The record as it is laid out in Flash.
+ */
+static uint64_t RecordPhrase(const TLogRecord* const record)
+{
+  return (uint64_t)record->seconds | ((uint64_t)record->fraction << 32) | ((uint64_t)(uint16_t)record->value << 48);
+}
+
+/*! @brief Finds the number of records in a sector that was not closed.
+ *
+ *  Records are written in order, so a binary search finds the first erased one.
+ *  @param slot The sector slot.
+ *  @return uint16_t - The number of records before the first erased record.
+ */
+static uint16_t SectorEnd(const uint8_t slot)
+{
+  uint16_t low = 0, high = LOG_RECORDS_PER_SECTOR, middle;
+
+  while (low < high)
+    {
+      middle = (low + high) / 2;
+      if (RecordSeconds(slot, middle) != 0xFFFFFFFF)
+	low = middle + 1;
+      else
+	high = middle;
+    }
+
+  return low;
+}
+
+/*! @brief Finds where a record is held in the ring.
+ *
+ *  Sectors closed after a failed write hold fewer records than the rest, so the sectors are walked from the oldest.
+ *  @param index The position of the record, where 0 is the oldest record in the log.
+ *  @param slot Where to store the sector slot holding the record.
+ *  @param recordNb Where to store the position of the record in the sector.
+ *  @return bool - TRUE if the record exists.
+ *  @note Assumes the caller holds LogMutex.
+ */
+static bool LocateRecord(const uint32_t index, uint8_t* const slot, uint16_t* const recordNb)
+{
+  uint32_t remaining = index;
+
+  if (index >= Records)
+    return FALSE;
+
+  for (uint8_t i = 0; i < SlotsUsed; i++)
+    {
+      *slot = (OldestSlot + i) % FLASH_LOG_NB_SECTORS;
+      if (remaining < Span[*slot].count)
+	{
+	  *recordNb = (uint16_t)remaining;
+	  return TRUE;
+	}
+      remaining -= Span[*slot].count;
+    }
+
+  return FALSE;
+}
+
+/*! @brief Reads the time of a record directly from Flash.
+ *
+ *  @param slot The sector slot.
+ *  @param recordNb The position of the record in the sector.
+ *  @return uint32_t - The seconds field of the record.
+ */
+static uint32_t RecordSeconds(const uint8_t slot, const uint16_t recordNb)
+{
+  return _FW(SlotAddress(slot) + LOG_HEADER_SIZE + recordNb * sizeof(TLogRecord));
+}
+
+/*! @brief Gets the address of a sector slot of the ring.
+ *
+ *  @param slot The sector slot.
+ *  @return uint32_t - The address of the start of the sector.
+ */
+static uint32_t SlotAddress(const uint8_t slot)
+{
+  return FLASH_LOG_START + slot * FLASH_SECTOR_SIZE;
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,115 @@
+/*! @file
+ *
+ *  @brief Routines for logging analog samples to Flash.
+ *
+ *  This contains the functions for recording timestamped samples in a ring of Flash sectors,
+ *  so they are kept while the PC is not connected and can be uploaded later.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-22
+ */
+/*!
+**  @addtogroup Logger_module Logger module documentation
+**  @{
+*/
+#ifndef LOGGER_H
+#define LOGGER_H
+
+// new types
+#include "types.h"
+
+#pragma pack(push)
+#pragma pack(1)
+
+/*!
+ * A logged sample occupies one 8-byte Flash phrase.
+ */
+typedef struct
+{
+  uint32_t seconds;   /*!< The RTC seconds counter when the sample was taken. */
+  uint16_t fraction;  /*!< Bits 15-4 hold the fraction of the second in units of 1/4096 s, bits 3-0 hold the channel number. */
+  int16_t value;      /*!< The sample value. */
+} TLogRecord;
+
+#pragma pack(pop)
+
+/*! @brief Sets up the logger before first use.
+ *
+ *  Finds the extent of the log left in Flash by a previous run.
+ *  Logging is disabled until Logger_Enable is called.
+ *  @return bool - TRUE if the logger was successfully initialized.
+ *  @note Assumes Flash and the RTC have been initialized and interrupts are enabled.
+ */
+bool Logger_Init(void);
+
+/*! @brief Starts or stops logging.
+ *
+ *  @param enable TRUE to record samples passed to Logger_Append, FALSE to stop.
+ *  @note Samples still in the RAM buffer are written to Flash when logging stops.
+ */
+void Logger_Enable(const bool enable);
+
+/*! @brief Reports whether logging is enabled.
+ *
+ *  @return bool - TRUE if samples are being logged.
+ */
+bool Logger_IsEnabled(void);
+
+/*! @brief Records a sample.
+ *
+ *  The sample is timestamped and placed in a RAM buffer, which is written to Flash in batches
+ *  by the logger thread. This never waits for Flash.
+ *  @param channelNb The analog channel the sample was taken from (0-15).
+ *  @param value The sample value.
+ *  @return bool - TRUE if the sample was recorded, FALSE if logging is disabled or the buffer is full.
+ */
+bool Logger_Append(const uint8_t channelNb, const int16_t value);
+
+/*! @brief Gets the number of samples that were not logged.
+ *
+ *  A sample is lost if both RAM batches are waiting for Flash when it arrives,
+ *  or if it could not be written to Flash even after a retry in a new sector.
+ *  @return uint32_t - The number of samples lost since the logger was initialized.
+ */
+uint32_t Logger_Lost(void);
+
+/*! @brief Gets the number of records held in the log.
+ *
+ *  @return uint32_t - The number of records in Flash.
+ */
+uint32_t Logger_Count(void);
+
+/*! @brief Finds the first record in the log taken at or after a given time.
+ *
+ *  Uses the time span of each sector to binary search the sectors, then binary searches the records in one sector.
+ *  @param seconds The RTC seconds counter value to search for.
+ *  @param index Where to store the index of the record, or the number of records if every record is earlier.
+ *  @return bool - TRUE if such a record exists.
+ *  @note Assumes the RTC has not been set backwards while logging.
+ */
+bool Logger_Find(const uint32_t seconds, uint32_t* const index);
+
+/*! @brief Reads a record from the log.
+ *
+ *  @param index The position of the record, where 0 is the oldest record in the log.
+ *  @param record Where to store the record.
+ *  @return bool - TRUE if the record exists.
+ */
+bool Logger_Get(const uint32_t index, TLogRecord* const record);
+
+/*! @brief Writes out the samples held in RAM, then holds off all writes to the log, so its sectors can be copied.
+ *
+ *  Logging is paused until Logger_Unlock is called. Samples passed to Logger_Append in the meantime are not logged.
+ *  @note Assumes the logger has been initialized. Must not be called from the logger thread.
+ */
+void Logger_Lock(void);
+
+/*! @brief Lets the log be written again after Logger_Lock, and resumes logging if it was enabled.
+ */
+void Logger_Unlock(void);
+
+#endif
+
+/*!
+** @}
+*/
@@ -0,0 +1,152 @@
+/*! @file
+ *
+ *  @brief Routines for detecting events on the analog inputs.
+ *
+ *  This contains the functions for deciding when the value of an analog input is worth sending in asynchronous mode:
+ *  when it moves outside a deadband around the value last sent, crosses the limits of a window with hysteresis,
+ *  or changes faster than a set rate.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-28
+ */
+/*!
+**  @addtogroup Monitor_module Monitor module documentation
+**  @{
+*/
+// header files used
+#include "Monitor.h"
+#include "PE_Types.h"
+
+//where the value is relative to the window
+typedef enum
+{
+  ZONE_NORMAL,
+  ZONE_HIGH,
+  ZONE_LOW
+} TZone;
+
+typedef struct
+{
+  int16_t settings[MONITOR_NB_SETTINGS];  /*!< The value of each setting. */
+  bool primed;                            /*!< TRUE once the channel has been checked since it was enabled. */
+  int16_t reported;                       /*!< The value last reported. */
+  int16_t previous;                       /*!< The value at the last check. */
+  TZone zone;                             /*!< Where the value was relative to the window at the last check. */
+} TMonitor;
+
+static TMonitor Monitors[ANALOG_NB_INPUTS];
+
+/*************************function prototypes***************************/
+static int32_t Distance(const int16_t a, const int16_t b);
+/***********************************************************************/
+
+
+void Monitor_Init(void)
+{
+  for (uint8_t i = 0; i < ANALOG_NB_INPUTS; i++)
+    {
+      Monitors[i].settings[MONITOR_ENABLE] = 0;
+      Monitors[i].settings[MONITOR_DEADBAND] = 0;
+      Monitors[i].settings[MONITOR_LOW] = INT16_MIN;
+      Monitors[i].settings[MONITOR_HIGH] = INT16_MAX;
+      Monitors[i].settings[MONITOR_HYSTERESIS] = 0;
+      Monitors[i].settings[MONITOR_RATE] = 0;
+      Monitors[i].primed = FALSE;
+      Monitors[i].zone = ZONE_NORMAL;
+    }
+}
+
+
+bool Monitor_Set(const uint8_t channelNb, const TMonitorSetting setting, const int16_t value)
+{
+  if (channelNb >= ANALOG_NB_INPUTS || setting >= MONITOR_NB_SETTINGS)
+    return FALSE;
+
+  if (setting == MONITOR_ENABLE && value != 0 && value != 1)
+    return FALSE;
+  //the distances cannot be negative
+  if ((setting == MONITOR_DEADBAND || setting == MONITOR_HYSTERESIS || setting == MONITOR_RATE) && value < 0)
+    return FALSE;
+
+  if (setting == MONITOR_ENABLE && value && !Monitors[channelNb].settings[MONITOR_ENABLE])
+    {
+      Monitors[channelNb].primed = FALSE;
+      Monitors[channelNb].zone = ZONE_NORMAL;
+    }
+
+  Monitors[channelNb].settings[setting] = value;
+  return TRUE;
+}
+
+
+int16_t Monitor_Get(const uint8_t channelNb, const TMonitorSetting setting)
+{
+  if (channelNb >= ANALOG_NB_INPUTS || setting >= MONITOR_NB_SETTINGS)
+    return 0;
+
+  return Monitors[channelNb].settings[setting];
+}
+
+
+uint8_t Monitor_Check(const uint8_t channelNb, const int16_t value)
+{
+  TMonitor* monitor;
+  const int16_t* settings;
+  uint8_t events = 0;
+
+  if (channelNb >= ANALOG_NB_INPUTS || !Monitors[channelNb].settings[MONITOR_ENABLE])
+    return 0;
+
+  monitor = &Monitors[channelNb];
+  settings = monitor->settings;
+
+  //the first value after the channel is enabled is always reported, so the PC knows where it starts
+  if (!monitor->primed || Distance(value, monitor->reported) > settings[MONITOR_DEADBAND])
+    {
+      events |= MONITOR_EVENT_CHANGE;
+      monitor->reported = value;
+    }
+
+  if (monitor->primed && settings[MONITOR_RATE] && Distance(value, monitor->previous) > settings[MONITOR_RATE])
+    events |= MONITOR_EVENT_RATE;
+
+  monitor->previous = value;
+  monitor->primed = TRUE;
+
+  //a limit is crossed as soon as the value is past it, but the value has to come back past the hysteresis to be normal again
+  if (monitor->zone != ZONE_HIGH && value > settings[MONITOR_HIGH])
+    {
+      monitor->zone = ZONE_HIGH;
+      events |= MONITOR_EVENT_HIGH;
+    }
+  else if (monitor->zone != ZONE_LOW && value < settings[MONITOR_LOW])
+    {
+      monitor->zone = ZONE_LOW;
+      events |= MONITOR_EVENT_LOW;
+    }
+  else if ((monitor->zone == ZONE_HIGH && (int32_t)value <= (int32_t)settings[MONITOR_HIGH] - settings[MONITOR_HYSTERESIS])
+	   || (monitor->zone == ZONE_LOW && (int32_t)value >= (int32_t)settings[MONITOR_LOW] + settings[MONITOR_HYSTERESIS]))
+    {
+      monitor->zone = ZONE_NORMAL;
+      events |= MONITOR_EVENT_NORMAL;
+    }
+
+  return events;
+}
+
+/*! @brief Finds how far apart two values are.
+ *
+ *  @param a is one value.
+ *  @param b is the other value.
+ *  @return int32_t - The distance between the values, which can be more than an int16_t holds.
+ */
+static int32_t Distance(const int16_t a, const int16_t b)
+{
+  int32_t difference = (int32_t)a - b;
+
+  return (difference < 0) ? -difference : difference;
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,78 @@
+/*! @file
+ *
+ *  @brief Routines for detecting events on the analog inputs.
+ *
+ *  This contains the functions for deciding when the value of an analog input is worth sending in asynchronous mode:
+ *  when it moves outside a deadband around the value last sent, crosses the limits of a window with hysteresis,
+ *  or changes faster than a set rate.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-28
+ */
+/*!
+**  @addtogroup Monitor_module Monitor module documentation
+**  @{
+*/
+#ifndef MONITOR_H
+#define MONITOR_H
+
+// new types
+#include "types.h"
+#include "analog.h"
+
+// The events found by a check, as bits so that one check can find several
+#define MONITOR_EVENT_CHANGE 0x01  /*!< The value moved outside the deadband around the value last reported. */
+#define MONITOR_EVENT_HIGH   0x02  /*!< The value went above the high limit. */
+#define MONITOR_EVENT_LOW    0x04  /*!< The value went below the low limit. */
+#define MONITOR_EVENT_NORMAL 0x08  /*!< The value came back inside the limits, by at least the hysteresis. */
+#define MONITOR_EVENT_RATE   0x10  /*!< The value changed by more than the maximum rate since the last check. */
+
+// The settings of the monitor of each channel
+typedef enum
+{
+  MONITOR_ENABLE,      /*!< 1 if the channel is checked, 0 if it is not. */
+  MONITOR_DEADBAND,    /*!< How far the value can move from the value last reported without being reported again, 0 to report every change. */
+  MONITOR_LOW,         /*!< The low limit of the window. */
+  MONITOR_HIGH,        /*!< The high limit of the window. */
+  MONITOR_HYSTERESIS,  /*!< How far back inside a limit the value has to come before it is normal again. */
+  MONITOR_RATE,        /*!< The largest change between checks that is not an event, or 0 to ignore the rate. */
+  MONITOR_NB_SETTINGS
+} TMonitorSetting;
+
+/*! @brief Sets up the monitors before first use.
+ *
+ *  Every channel is disabled, with no deadband, hysteresis or rate, and limits that cannot be crossed.
+ */
+void Monitor_Init(void);
+
+/*! @brief Changes a setting of the monitor of a channel.
+ *
+ *  Enabling a channel makes its next check report the value.
+ *  @param channelNb is the number of the analog input channel.
+ *  @param setting is the setting to change.
+ *  @param value is the new value of the setting.
+ *  @return bool - TRUE if the setting was changed, FALSE if the channel, setting or value is not valid.
+ */
+bool Monitor_Set(const uint8_t channelNb, const TMonitorSetting setting, const int16_t value);
+
+/*! @brief Gets a setting of the monitor of a channel.
+ *
+ *  @param channelNb is the number of the analog input channel.
+ *  @param setting is the setting.
+ *  @return int16_t - The value of the setting, or 0 if the channel or setting is not valid.
+ */
+int16_t Monitor_Get(const uint8_t channelNb, const TMonitorSetting setting);
+
+/*! @brief Checks the latest value of a channel for events.
+ *
+ *  @param channelNb is the number of the analog input channel.
+ *  @param value is the latest value.
+ *  @return uint8_t - The MONITOR_EVENT bits of the events found, or 0 if there were none or the channel is disabled.
+ */
+uint8_t Monitor_Check(const uint8_t channelNb, const int16_t value);
+
+#endif
+
+/*!
+** @}
+*/
@@ -100,6 +100,22 @@ void PIT_Set(const uint32_t period, const bool restart)
 }
 
 
+void PIT_SetTrigger(const uint8_t channelNb, const uint32_t period)
+{
+  if (channelNb == 0 || channelNb > 3)
+    return;
+
+  //stop the timer, so a new period starts from the beginning
+  PIT_TCTRL_REG(PIT_BASE_PTR, channelNb) = 0;
+
+  if (period)
+    {
+      PIT_LDVAL_REG(PIT_BASE_PTR, channelNb) = ((period / (1000000000 / ModuleClk)) - 1);
+      PIT_TCTRL_REG(PIT_BASE_PTR, channelNb) = PIT_TCTRL_TEN_MASK;
+    }
+}
+
+
 void PIT_Enable(const bool enable)
 {
   if (enable)
@@ -38,6 +38,16 @@ bool PIT_Init(const uint32_t moduleClk, void (*userFunction)(void*), void* userA
  */
 void PIT_Set(const uint32_t period, const bool restart);
 
+/*! @brief Sets a PIT channel to trigger DMA requests periodically.
+ *
+ *  PIT channels 1 to 3 gate the DMA channels with the same numbers through the DMA multiplexer, so they run without interrupts.
+ *  Channel 0 is the periodic interrupt set by PIT_Set.
+ *  @param channelNb The PIT channel, from 1 to 3.
+ *  @param period The desired value of the trigger period in nanoseconds, or 0 to stop the trigger.
+ *  @note Assumes that the PIT has been initialized.
+ */
+void PIT_SetTrigger(const uint8_t channelNb, const uint32_t period);
+
 /*! @brief Enables or disables the PIT.
  *
  *  @param enable - TRUE if the PIT is to be enabled, FALSE if the PIT is to be disabled.
@@ -19,6 +19,41 @@
 #include "OS.h"
 #include "ThreadManage.h"
 
+//prescaler cycles of 1/32768 s the oscillator has to run for before it is considered stable
+#define RTC_OSC_SETTLE_COUNT 0x2000
+//the prescaler counts 1/32768 s, and the seconds counter increments each time its low 15 bits roll over
+#define RTC_PRESCALER_MASK 0x7FFF
+
+//divides by a constant with a multiply, keeping the high bits of the 64-bit product
+//each multiplier and shift below is exact for the range of values it is used with
+#define DIVIDE(x, multiplier, shift) ((uint32_t)(((uint64_t)(x) * (multiplier)) >> (shift)))
+#define DIVIDE_BY_86400(x) DIVIDE(x, 0xC22E4507LU, 48)   //x < 2^32
+#define DIVIDE_BY_3600(x)  DIVIDE(x, 0x00123457LU, 32)   //x < 86400
+#define DIVIDE_BY_60(x)    DIVIDE(x, 0x04444445LU, 32)   //x < 3600
+#define DIVIDE_BY_146097(x) DIVIDE(x, 0x00072D61LU, 36)  //x < 800000
+#define DIVIDE_BY_36524(x) DIVIDE(x, 0x000396B3LU, 33)   //x < 146097
+#define DIVIDE_BY_1460(x)  DIVIDE(x, 0x002CE33FLU, 32)   //x < 146097
+#define DIVIDE_BY_365(x)   DIVIDE(x, 0x00B38CFALU, 32)   //x < 146097
+#define DIVIDE_BY_400(x)   DIVIDE(x, 0x00A3D70BLU, 32)   //x < 2200
+#define DIVIDE_BY_153(x)   DIVIDE(x, 0x01AC5702LU, 32)   //x < 1830
+#define DIVIDE_BY_100(x)   DIVIDE(x, 0x028F5C29LU, 32)   //x < 2200
+#define DIVIDE_BY_5(x)     DIVIDE(x, 0x33333334LU, 32)   //x < 1690
+
+#define SECONDS_PER_DAY 86400
+//the calendar repeats every 400 years, an era, counted from 0000-03-01 so that the leap day ends each year
+#define DAYS_PER_ERA 146097
+#define DAYS_0000_03_01_TO_1970_01_01 719468
+//the last time the seconds counter can hold is 2106-02-07 06:28:15
+#define RTC_YEAR_MIN 1970
+#define RTC_YEAR_MAX 2106
+
+//a clock sync whose round trip takes longer than this, in 1/32768 s, is too uncertain to use
+#define RTC_SYNC_MAX_DELAY 0x2000
+//the drift is only estimated from syncs at least this many seconds apart, so the round trip jitter is small in comparison
+#define RTC_SYNC_MIN_INTERVAL 60
+//the largest compensation, in 1/256 of a prescaler cycle per second, that the compensation register can apply
+#define RTC_COMPENSATION_MAX (127 * 256)
+
 
 
 //pointer and arguments to user call back function
@@ -29,9 +64,47 @@ static void* CallBackArgument;
 OS_THREAD_STACK(RTCStack, THREAD_STACK_SIZE);
 //semaphore used in thread
 static OS_ECB* SecondPassed;
+//TRUE from when the oscillator is turned on until it has been seen to run
+static bool OscStarting;
+
+//alarm thread stack
+OS_THREAD_STACK(RTCAlarmStack, THREAD_STACK_SIZE);
+//alarms waiting to go off, soonest first
+static TRTCAlarm* AlarmQueue;
+//protects the alarm queue and the alarm registers
+static OS_ECB* AlarmMutex;
+//signalled when the alarm at the head of the queue may be due
+static OS_ECB* AlarmDue;
+
+//the time the clock sync request was answered, in 1/32768 s
+static uint64_t SyncStart;
+static bool SyncPending;
+//the time of the last sync, in seconds, which the drift is measured from
+static uint32_t LastSync;
+static bool LastSyncValid;
+//prescaler cycles per second, in 1/256 of a cycle, taken off each second to correct the oscillator drift
+static int32_t Compensation;
 
 static void RTCThread(void* arg);
 
+static void WaitForOscillator(void);
+
+static bool IsLeapYear(const uint16_t year);
+
+static void RTCAlarmThread(void* arg);
+
+static void QueueAlarm(TRTCAlarm* const alarm);
+
+static bool RemoveAlarm(TRTCAlarm* const alarm);
+
+static void ProgramAlarm(void);
+
+static uint32_t ReadSeconds(void);
+
+static void SetCounter(const uint32_t seconds, const uint16_t prescaler);
+
+static void ProgramCompensation(void);
+
 
 
 bool RTC_Init(void (*userFunction)(void*), void* userArguments)
@@ -41,6 +114,11 @@ bool RTC_Init(void (*userFunction)(void*), void* userArguments)
   //enables the RTC module
   SIM_SCGC6 |= SIM_SCGC6_RTC_MASK;
 
+  OscStarting = FALSE;
+  SyncPending = FALSE;
+  LastSyncValid = FALSE;
+  Compensation = 0;
+
   // reset and see if it works. pull it out of reset if it did reset
   RTC_CR |= RTC_CR_SWR_MASK;
   if (RTC_CR & RTC_CR_SWR_MASK)
@@ -49,12 +127,12 @@ bool RTC_Init(void (*userFunction)(void*), void* userArguments)
       RTC_CR &= ~RTC_CR_SWR_MASK;
       //Set oscillator load
       RTC_CR |= (RTC_CR_SC2P_MASK | RTC_CR_SC16P_MASK);
-      //turns on the oscillator
+      //turns on the oscillator, the RTC thread waits for it to start so the rest of the tower can start up meanwhile
       RTC_CR |= RTC_CR_OSCE_MASK;
+      OscStarting = TRUE;
 
-      //wait for the oscillator to become stable
-      for (uint32_t i=0; i<=4200000; i++)
-      	{/*wait*/}
+      //no compensation until the drift of this oscillator has been measured
+      RTC_TCR = 0;
 
       //lock the registers
       RTC_LR &= ~RTC_LR_CRL_MASK;
@@ -67,14 +145,25 @@ bool RTC_Init(void (*userFunction)(void*), void* userArguments)
           }
     }
 
-  //set the NVIC registers
+  //the invalid, overflow and alarm interrupts share the alarm vector and are enabled out of reset, only the alarm is used
+  RTC_IER &= ~(RTC_IER_TIIE_MASK | RTC_IER_TOIE_MASK | RTC_IER_TAIE_MASK);
+
+  //set the NVIC registers for the alarm and seconds interrupts
+  NVICISER2 |= NVIC_ISER_SETENA(1 << (66 % 32));
+  NVICICPR2 |= NVIC_ICPR_CLRPEND(1 << (66 % 32));
   NVICISER2 |= NVIC_ISER_SETENA(1 << (67 % 32));
   NVICICPR2 |= NVIC_ICPR_CLRPEND(1 << (67 % 32));
 
 
-  //Enable counter and time seconds interrupt
+  //Enable counter, it counts once the oscillator is running
   RTC_SR |= RTC_SR_TCE_MASK;
-  RTC_IER |= RTC_IER_TSIE_MASK;
+  //the time seconds interrupt is enabled by the RTC thread if the oscillator is still starting
+  if (!OscStarting)
+    RTC_IER |= RTC_IER_TSIE_MASK;
+
+  //the compensation register keeps its value through a warm reset, so carry on with the compensation it holds
+  if (!OscStarting)
+    Compensation = (int32_t)(int8_t)(RTC_TCR & RTC_TCR_TCR_MASK) * 256 / (int32_t)(((RTC_TCR & RTC_TCR_CIR_MASK) >> RTC_TCR_CIR_SHIFT) + 1);
 
   //set user callback functions
   CallBack = userFunction;
@@ -86,6 +175,11 @@ bool RTC_Init(void (*userFunction)(void*), void* userArguments)
   //create semaphore
   SecondPassed = OS_SemaphoreCreate(0);
 
+  AlarmQueue = NULL;
+  AlarmMutex = OS_SemaphoreCreate(1);
+  AlarmDue = OS_SemaphoreCreate(0);
+  OS_ThreadCreate(RTCAlarmThread, NULL, &RTCAlarmStack[THREAD_STACK_SIZE - 1], RTC_ALARM_THREAD);
+
   OS_EnableInterrupts();
 
   return TRUE;
@@ -96,14 +190,11 @@ void RTC_Set(const uint8_t hours, const uint8_t minutes, const uint8_t seconds)
 {
   if (hours < 24 && minutes < 60 && seconds < 60 )//checks time is valid
     {
-      uint32_t counterTime = (hours * 3600) + (minutes * 60) + seconds;
-
-      //Disable counter, set prescaler and seconds register, then enable
-      RTC_SR &= ~RTC_SR_TCE_MASK;
-      RTC_TPR = 0x00;
-      RTC_TSR = counterTime;
-      RTC_SR |= RTC_SR_TCE_MASK;
+      //keep the date and change the time of day
+      uint32_t counterTime = DIVIDE_BY_86400(RTC_TSR) * SECONDS_PER_DAY;
 
+      counterTime += (hours * 3600) + (minutes * 60) + seconds;
+      RTC_SetEpoch(counterTime);
     }
 }
 
@@ -118,14 +209,273 @@ void RTC_Get(uint8_t* const hours, uint8_t* const minutes, uint8_t* const second
     {
       counterTime = RTC_TSR;
     }
-  *seconds = counterTime % 60;
-  counterTime /= 60;
 
-  *minutes = counterTime % 60;
-  counterTime /= 60;
+  //only the time of day is wanted
+  counterTime -= DIVIDE_BY_86400(counterTime) * SECONDS_PER_DAY;
+
+  *hours = (uint8_t)DIVIDE_BY_3600(counterTime);
+  counterTime -= *hours * 3600;
+
+  *minutes = (uint8_t)DIVIDE_BY_60(counterTime);
+  *seconds = (uint8_t)(counterTime - *minutes * 60);
+}
+
+
+void RTC_SetEpoch(const uint32_t seconds)
+{
+  SetCounter(seconds, 0);
+
+  //the drift cannot be measured across a time that was set by hand
+  LastSyncValid = FALSE;
+}
+
+
+bool RTC_SetDateTime(const TRTCDateTime* const dateTime)
+{
+  uint32_t seconds;
+
+  if (!RTC_DateTimeToEpoch(dateTime, &seconds))
+    return FALSE;
+
+  RTC_SetEpoch(seconds);
+  return TRUE;
+}
+
+
+bool RTC_SetDate(const uint16_t year, const uint8_t month, const uint8_t day)
+{
+  TRTCDateTime dateTime;
+  uint32_t seconds;
+  uint16_t prescaler;
+
+  //the counter is stopped while the new date is worked out, so the time of day carries over exactly
+  RTC_SR &= ~RTC_SR_TCE_MASK;
+  prescaler = (uint16_t)RTC_TPR;
+  RTC_EpochToDateTime(RTC_TSR, &dateTime);
+
+  dateTime.year = year;
+  dateTime.month = month;
+  dateTime.day = day;
+
+  if (!RTC_DateTimeToEpoch(&dateTime, &seconds))
+    {
+      RTC_SR |= RTC_SR_TCE_MASK;
+      return FALSE;
+    }
+
+  SetCounter(seconds, prescaler);
+
+  //the drift cannot be measured across a time that was set by hand
+  LastSyncValid = FALSE;
+  return TRUE;
+}
+
+
+void RTC_GetDateTime(TRTCDateTime* const dateTime, uint32_t* const microseconds)
+{
+  uint32_t seconds;
+  uint16_t prescaler;
+
+  RTC_GetCounter(&seconds, &prescaler);
+  RTC_EpochToDateTime(seconds, dateTime);
+
+  if (microseconds)
+    *microseconds = RTC_PRESCALER_TO_US(prescaler);
+}
+
+
+uint64_t RTC_GetTimestamp(void)
+{
+  uint32_t seconds;
+  uint16_t prescaler;
+
+  RTC_GetCounter(&seconds, &prescaler);
+  return ((uint64_t)seconds << 15) | prescaler;
+}
+
+
+void RTC_EpochToDateTime(const uint32_t seconds, TRTCDateTime* const dateTime)
+{
+  uint32_t days = DIVIDE_BY_86400(seconds);
+  uint32_t time = seconds - days * SECONDS_PER_DAY;
+  uint32_t dayNb, era, dayOfEra, yearOfEra, dayOfYear, monthNb;
+
+  //count the days from 0000-03-01, and split them into eras and then years of 365 days with a leap day every 4 years,
+  //except every 100 years, except every 400 years
+  dayNb = days + DAYS_0000_03_01_TO_1970_01_01;
+  era = DIVIDE_BY_146097(dayNb);
+  dayOfEra = dayNb - era * DAYS_PER_ERA;
+  yearOfEra = DIVIDE_BY_365(dayOfEra - DIVIDE_BY_1460(dayOfEra) + DIVIDE_BY_36524(dayOfEra) - (dayOfEra == DAYS_PER_ERA - 1));
+  dayOfYear = dayOfEra - (365 * yearOfEra + (yearOfEra >> 2) - DIVIDE_BY_100(yearOfEra));
+
+  //months from March have 153 days every 5 months
+  monthNb = DIVIDE_BY_153(5 * dayOfYear + 2);
+  dateTime->day = (uint8_t)(dayOfYear - DIVIDE_BY_5(153 * monthNb + 2) + 1);
+  dateTime->month = (uint8_t)(monthNb < 10 ? monthNb + 3 : monthNb - 9);
+  dateTime->year = (uint16_t)(era * 400 + yearOfEra + (dateTime->month <= 2));
+
+  dateTime->hours = (uint8_t)DIVIDE_BY_3600(time);
+  time -= dateTime->hours * 3600;
+  dateTime->minutes = (uint8_t)DIVIDE_BY_60(time);
+  dateTime->seconds = (uint8_t)(time - dateTime->minutes * 60);
+}
+
+
+bool RTC_DateTimeToEpoch(const TRTCDateTime* const dateTime, uint32_t* const seconds)
+{
+  static const uint8_t DaysInMonth[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  uint32_t year, era, yearOfEra, dayOfYear, dayOfEra, monthNb;
+  uint64_t total;
+
+  //checks the date and time are valid
+  if (dateTime->year < RTC_YEAR_MIN || dateTime->year > RTC_YEAR_MAX ||
+      dateTime->month < 1 || dateTime->month > 12 || dateTime->day < 1 ||
+      dateTime->hours > 23 || dateTime->minutes > 59 || dateTime->seconds > 59)
+    return FALSE;
+  if (dateTime->day > DaysInMonth[dateTime->month - 1] + (dateTime->month == 2 && IsLeapYear(dateTime->year)))
+    return FALSE;
+
+  //years start on 1 March, so January and February belong to the year before
+  year = dateTime->year - (dateTime->month <= 2);
+  era = DIVIDE_BY_400(year);
+  yearOfEra = year - era * 400;
+  monthNb = dateTime->month > 2 ? dateTime->month - 3 : dateTime->month + 9;
+  dayOfYear = DIVIDE_BY_5(153 * monthNb + 2) + dateTime->day - 1;
+  dayOfEra = yearOfEra * 365 + (yearOfEra >> 2) - DIVIDE_BY_100(yearOfEra) + dayOfYear;
+
+  total = (uint64_t)(era * DAYS_PER_ERA + dayOfEra - DAYS_0000_03_01_TO_1970_01_01) * SECONDS_PER_DAY +
+          dateTime->hours * 3600 + dateTime->minutes * 60 + dateTime->seconds;
+
+  //the end of 2106 is past what the seconds counter can hold
+  if (total > 0xFFFFFFFF)
+    return FALSE;
+
+  *seconds = (uint32_t)total;
+  return TRUE;
+}
+
+
+void RTC_GetCounter(uint32_t* const seconds, uint16_t* const prescaler)
+{
+  uint32_t counterTime = RTC_TSR;
+  uint16_t counterFraction = (uint16_t)RTC_TPR;
+
+  //if the seconds rolled over between the reads, read the prescaler again
+  if (counterTime != RTC_TSR)
+    {
+      counterTime = RTC_TSR;
+      counterFraction = (uint16_t)RTC_TPR;
+    }
+
+  *seconds = counterTime;
+  *prescaler = counterFraction & RTC_PRESCALER_MASK;
+}
+
+
+uint32_t RTC_SyncStart(void)
+{
+  SyncStart = RTC_GetTimestamp();
+  SyncPending = TRUE;
+
+  return (uint32_t)SyncStart & RTC_SYNC_MASK;
+}
+
+
+bool RTC_SyncFinish(const uint32_t reference, int32_t* const offset)
+{
+  uint64_t now = RTC_GetTimestamp();
+  uint64_t middle;
+  uint32_t elapsed;
+  int32_t difference;
+
+  if (!SyncPending)
+    return FALSE;
+  SyncPending = FALSE;
+
+  if (now - SyncStart > RTC_SYNC_MAX_DELAY)
+    return FALSE;
+
+  //the reference was taken half way through the round trip, and only its low 24 bits were sent
+  middle = SyncStart + ((now - SyncStart) >> 1);
+  difference = (int32_t)(((reference - (uint32_t)middle) & RTC_SYNC_MASK) << 8) >> 8;
+
+  now += difference;
+  SetCounter((uint32_t)(now >> 15), (uint16_t)now & RTC_PRESCALER_MASK);
+
+  //the clock was out by the difference over the time since the last sync, less what the compensation already corrected
+  //half of the error is added to the compensation, so the jitter in each measurement is filtered out over several syncs
+  elapsed = (uint32_t)(middle >> 15) - LastSync;
+  if (LastSyncValid && elapsed >= RTC_SYNC_MIN_INTERVAL)
+    {
+      Compensation += (int32_t)(((int64_t)difference * 256 / (int32_t)elapsed) / 2);
+
+      if (Compensation > RTC_COMPENSATION_MAX)
+	Compensation = RTC_COMPENSATION_MAX;
+      else if (Compensation < -RTC_COMPENSATION_MAX)
+	Compensation = -RTC_COMPENSATION_MAX;
+
+      ProgramCompensation();
+    }
+
+  LastSync = (uint32_t)(middle >> 15);
+  LastSyncValid = TRUE;
+
+  if (offset)
+    *offset = difference;
+
+  return TRUE;
+}
+
+
+int32_t RTC_GetDrift(void)
+{
+  //one prescaler cycle per second is 1e9 / 32768 ppb, and the compensation is in 1/256 of a cycle
+  return (int32_t)(-(int64_t)Compensation * 1953125 / 16384);
+}
+
+
+bool RTC_AlarmSet(TRTCAlarm* const alarm)
+{
+  if (!alarm->callbackFunction)
+    return FALSE;
+
+  (void)OS_SemaphoreWait(AlarmMutex, 0);
+
+  //an alarm that is already queued is moved to its new time
+  (void)RemoveAlarm(alarm);
+  QueueAlarm(alarm);
+  ProgramAlarm();
+
+  (void)OS_SemaphoreSignal(AlarmMutex);
+
+  return TRUE;
+}
+
+
+bool RTC_AlarmCancel(TRTCAlarm* const alarm)
+{
+  bool removed;
+
+  (void)OS_SemaphoreWait(AlarmMutex, 0);
+
+  removed = RemoveAlarm(alarm);
+  ProgramAlarm();
+
+  (void)OS_SemaphoreSignal(AlarmMutex);
+
+  return removed;
+}
 
-  *hours = counterTime % 24;
 
+void __attribute__ ((interrupt)) RTC_AlarmISR(void)
+{
+  OS_ISREnter();
+
+  //the alarm flag stays set until the alarm register is written, which the alarm thread does when it programs the next alarm
+  RTC_IER &= ~RTC_IER_TAIE_MASK;
+
+  (void)OS_SemaphoreSignal(AlarmDue);
+  OS_ISRExit();
 }
 
 
@@ -138,8 +488,46 @@ void __attribute__ ((interrupt)) RTC_ISR(void)
 
 }
 
+/*! @brief Waits for the oscillator to start, then enables the time seconds interrupt.
+ *
+ *  The RTC has no oscillator ready flag, so the prescaler is polled once a tick until the oscillator clocks it.
+ *  It then has to count RTC_OSC_SETTLE_COUNT more cycles, so the clock is stable before the first second is reported.
+ *  Setting the time while waiting ends the wait.
+ */
+static void WaitForOscillator(void)
+{
+  uint16_t start = (uint16_t)RTC_TPR;
+
+  while ((uint16_t)RTC_TPR == start && RTC_TSR == 0)
+    OS_TimeDelay(1);
+
+  start = (uint16_t)RTC_TPR;
+  while ((uint16_t)((uint16_t)RTC_TPR - start) < RTC_OSC_SETTLE_COUNT && RTC_TSR == 0)
+    OS_TimeDelay(1);
+
+  OscStarting = FALSE;
+  RTC_IER |= RTC_IER_TSIE_MASK;
+}
+
+/*! @brief Checks whether a year has a 29th of February.
+ *
+ *  A year divisible by 100 is divisible by 400 exactly when it is divisible by 16.
+ *  @param year The year.
+ *  @return bool - TRUE if the year is a leap year.
+ */
+static bool IsLeapYear(const uint16_t year)
+{
+  if (year & 0x03)
+    return FALSE;
+
+  return (year != DIVIDE_BY_100(year) * 100) || !(year & 0x0F);
+}
+
 static void RTCThread(void* arg)
 {
+  if (OscStarting)
+    WaitForOscillator();
+
   for(;;)
     {
       (void)OS_SemaphoreWait(SecondPassed, 0);
@@ -149,9 +537,169 @@ static void RTCThread(void* arg)
     }
 }
 
-/*!
-** @}
-*/
+/*! @brief Calls the user callback function of each alarm as it becomes due.
+ *
+ *  Due alarms are taken from the queue one at a time, so a callback can set or cancel alarms.
+ *  A repeating alarm is queued again for its next time before its callback is called.
+ */
+static void RTCAlarmThread(void* arg)
+{
+  TRTCAlarm* alarm;
+  void (*function)(void*);
+  void* arguments;
+  uint32_t now;
+
+  for (;;)
+    {
+      (void)OS_SemaphoreWait(AlarmDue, 0);
+
+      for (;;)
+	{
+	  (void)OS_SemaphoreWait(AlarmMutex, 0);
+
+	  now = ReadSeconds();
+	  alarm = AlarmQueue;
+	  if (!alarm || alarm->seconds > now)
+	    break;
+
+	  AlarmQueue = alarm->next;
+	  function = alarm->callbackFunction;
+	  arguments = alarm->callbackArguments;
+
+	  //a repeating alarm keeps its phase, skipping any times missed while the clock was set forward
+	  if (alarm->period)
+	    {
+	      alarm->seconds += ((now - alarm->seconds) / alarm->period + 1) * alarm->period;
+	      QueueAlarm(alarm);
+	    }
+
+	  (void)OS_SemaphoreSignal(AlarmMutex);
+
+	  (*function)(arguments);
+	}
+
+      ProgramAlarm();
+      (void)OS_SemaphoreSignal(AlarmMutex);
+    }
+}
+
+/*! @brief Adds an alarm to the queue, after any alarms due at the same time.
+ *
+ *  @param alarm The alarm.
+ *  @note Assumes the alarm mutex is held.
+ */
+static void QueueAlarm(TRTCAlarm* const alarm)
+{
+  TRTCAlarm** link = &AlarmQueue;
+
+  while (*link && (*link)->seconds <= alarm->seconds)
+    link = &(*link)->next;
+
+  alarm->next = *link;
+  *link = alarm;
+}
+
+/*! @brief Takes an alarm out of the queue.
+ *
+ *  @param alarm The alarm.
+ *  @return bool - TRUE if the alarm was in the queue.
+ *  @note Assumes the alarm mutex is held.
+ */
+static bool RemoveAlarm(TRTCAlarm* const alarm)
+{
+  TRTCAlarm** link = &AlarmQueue;
+
+  while (*link && *link != alarm)
+    link = &(*link)->next;
+
+  if (!*link)
+    return FALSE;
+
+  *link = alarm->next;
+  alarm->next = NULL;
+  return TRUE;
+}
+
+/*! @brief Programs the alarm register for the alarm at the head of the queue.
+ *
+ *  The alarm flag is set as the seconds counter increments past the alarm register, so it is set to one second before the alarm.
+ *  If the alarm is already due, or becomes due while it is programmed, the alarm thread is signalled instead.
+ *  @note Assumes the alarm mutex is held.
+ */
+static void ProgramAlarm(void)
+{
+  if (!AlarmQueue)
+    {
+      RTC_IER &= ~RTC_IER_TAIE_MASK;
+      return;
+    }
+
+  //writing the alarm register also clears the alarm flag
+  RTC_TAR = AlarmQueue->seconds - 1;
+  RTC_IER |= RTC_IER_TAIE_MASK;
+
+  if (ReadSeconds() >= AlarmQueue->seconds)
+    (void)OS_SemaphoreSignal(AlarmDue);
+}
 
+/*! @brief Sets the seconds and prescaler counters.
+ *
+ *  Alarms that are now in the past go off, and the next alarm is programmed for the new time.
+ *  @param seconds The seconds since the epoch.
+ *  @param prescaler The fraction of the second, in 1/32768 s.
+ */
+static void SetCounter(const uint32_t seconds, const uint16_t prescaler)
+{
+  //Disable counter, set prescaler and seconds register, then enable
+  RTC_SR &= ~RTC_SR_TCE_MASK;
+  RTC_TPR = prescaler;
+  RTC_TSR = seconds;
+  RTC_SR |= RTC_SR_TCE_MASK;
+
+  (void)OS_SemaphoreWait(AlarmMutex, 0);
+  ProgramAlarm();
+  (void)OS_SemaphoreSignal(AlarmMutex);
+}
+
+/*! @brief Programs the compensation register to apply the drift compensation.
+ *
+ *  The register takes up to 127 prescaler cycles from one second in every 1 to 256 seconds.
+ *  The longest interval that keeps the cycles in range gives the finest resolution.
+ */
+static void ProgramCompensation(void)
+{
+  int32_t magnitude = (Compensation < 0) ? -Compensation : Compensation;
+  int32_t interval, cycles;
+
+  if (magnitude == 0)
+    {
+      RTC_TCR = 0;
+      return;
+    }
 
+  interval = RTC_COMPENSATION_MAX / magnitude;
+  if (interval > 256)
+    interval = 256;
 
+  cycles = (Compensation * interval + ((Compensation < 0) ? -128 : 128)) / 256;
+
+  RTC_TCR = RTC_TCR_CIR(interval - 1) | RTC_TCR_TCR((uint8_t)(int8_t)cycles);
+}
+
+/*! @brief Reads the seconds counter.
+ *
+ *  @return uint32_t - The seconds counter, read twice in case it was incrementing.
+ */
+static uint32_t ReadSeconds(void)
+{
+  uint32_t seconds = RTC_TSR;
+
+  if (seconds != RTC_TSR)
+    seconds = RTC_TSR;
+
+  return seconds;
+}
+
+/*!
+** @}
+*/
@@ -18,18 +18,47 @@
 // new types
 #include "types.h"
 
+// Converts a count of the prescaler, in 1/32768 s, to microseconds
+#define RTC_PRESCALER_TO_US(prescaler) (((uint32_t)(prescaler) * 15625) >> 9)
+
+// The clock sync exchanges the low 24 bits of times in 1/32768 s, so the clocks must agree to within 256 s
+#define RTC_SYNC_MASK 0x00FFFFFFLU
+
+// A calendar date and time
+typedef struct
+{
+  uint16_t year;    /*!< The year, from 1970 to 2106. */
+  uint8_t month;    /*!< The month, from 1 for January to 12. */
+  uint8_t day;      /*!< The day of the month, from 1. */
+  uint8_t hours;    /*!< The hours (0-23). */
+  uint8_t minutes;  /*!< The minutes (0-59). */
+  uint8_t seconds;  /*!< The seconds (0-59). */
+} TRTCDateTime;
+
+// An alarm, which belongs to the caller and must stay in scope while it is set
+typedef struct RTCAlarm
+{
+  uint32_t seconds;                 /*!< When the alarm goes off, in seconds since the epoch. */
+  uint32_t period;                  /*!< The seconds between repeats of the alarm, or 0 for an alarm that goes off once. */
+  void (*callbackFunction)(void*);  /*!< The user callback function, called from the alarm thread. */
+  void* callbackArguments;          /*!< The user arguments to use with the user callback function. */
+  struct RTCAlarm* next;            /*!< Used by the RTC module to queue the alarm. */
+} TRTCAlarm;
+
 /*! @brief Initializes the RTC before first use.
  *
  *  Sets up the control register for the RTC and locks it.
  *  Enables the RTC and sets an interrupt every second.
+ *  If the oscillator was off it is started without waiting for it, and the interrupts begin once it is running.
  *  @param userFunction is a pointer to a user callback function.
  *  @param userArguments is a pointer to the user arguments to use with the user callback function.
  *  @return bool - TRUE if the RTC was successfully initialized.
  */
 bool RTC_Init(void (*userFunction)(void*), void* userArguments);
 
-/*! @brief Sets the value of the real time clock.
+/*! @brief Sets the time of day of the real time clock.
  *
+ *  The date is not changed.
  *  @param hours The desired value of the real time clock hours (0-23).
  *  @param minutes The desired value of the real time clock minutes (0-59).
  *  @param seconds The desired value of the real time clock seconds (0-59).
@@ -37,7 +66,7 @@ bool RTC_Init(void (*userFunction)(void*), void* userArguments);
  */
 void RTC_Set(const uint8_t hours, const uint8_t minutes, const uint8_t seconds);
 
-/*! @brief Gets the value of the real time clock.
+/*! @brief Gets the time of day of the real time clock.
  *
  *  @param hours The address of a variable to store the real time clock hours.
  *  @param minutes The address of a variable to store the real time clock minutes.
@@ -46,6 +75,122 @@ void RTC_Set(const uint8_t hours, const uint8_t minutes, const uint8_t seconds);
  */
 void RTC_Get(uint8_t* const hours, uint8_t* const minutes, uint8_t* const seconds);
 
+/*! @brief Sets the real time clock to a number of seconds since 1970-01-01 00:00:00.
+ *
+ *  @param seconds The number of seconds since the epoch.
+ *  @note Assumes that the RTC module has been initialized.
+ */
+void RTC_SetEpoch(const uint32_t seconds);
+
+/*! @brief Sets the date and time of the real time clock.
+ *
+ *  @param dateTime The date and time.
+ *  @return bool - TRUE if the date and time are valid and were set.
+ *  @note Assumes that the RTC module has been initialized.
+ */
+bool RTC_SetDateTime(const TRTCDateTime* const dateTime);
+
+/*! @brief Sets the date of the real time clock.
+ *
+ *  The time of day, down to the fraction of the second in the prescaler, is not changed.
+ *  @param year The year, from 1970 to 2106.
+ *  @param month The month, from 1 for January to 12.
+ *  @param day The day of the month, from 1.
+ *  @return bool - TRUE if the date is valid and was set.
+ *  @note Assumes that the RTC module has been initialized.
+ */
+bool RTC_SetDate(const uint16_t year, const uint8_t month, const uint8_t day);
+
+/*! @brief Gets the date and time of the real time clock.
+ *
+ *  @param dateTime The address of a variable to store the date and time.
+ *  @param microseconds The address of a variable to store the fraction of the second in microseconds, to a resolution of about 30 us, or NULL.
+ *  @note Assumes that the RTC module has been initialized.
+ */
+void RTC_GetDateTime(TRTCDateTime* const dateTime, uint32_t* const microseconds);
+
+/*! @brief Gets the time as a single number, for timestamping.
+ *
+ *  @return uint64_t - The seconds since the epoch in the upper bits and the prescaler, in 1/32768 s, in the low 15 bits.
+ *  @note Assumes that the RTC module has been initialized.
+ */
+uint64_t RTC_GetTimestamp(void);
+
+/*! @brief Converts seconds since the epoch to a date and time.
+ *
+ *  Uses multiplications in place of divisions, so it takes a fixed and short time.
+ *  @param seconds The number of seconds since 1970-01-01 00:00:00.
+ *  @param dateTime The address of a variable to store the date and time.
+ */
+void RTC_EpochToDateTime(const uint32_t seconds, TRTCDateTime* const dateTime);
+
+/*! @brief Converts a date and time to seconds since the epoch.
+ *
+ *  @param dateTime The date and time.
+ *  @param seconds The address of a variable to store the number of seconds since 1970-01-01 00:00:00.
+ *  @return bool - TRUE if the date and time are valid and in the range of the seconds counter.
+ */
+bool RTC_DateTimeToEpoch(const TRTCDateTime* const dateTime, uint32_t* const seconds);
+
+/*! @brief Gets the raw value of the real time clock counters.
+ *
+ *  @param seconds The address of a variable to store the seconds counter.
+ *  @param prescaler The address of a variable to store the prescaler counter, which counts 1/32768 of a second.
+ *  @note Assumes that the RTC module has been initialized.
+ */
+void RTC_GetCounter(uint32_t* const seconds, uint16_t* const prescaler);
+
+/*! @brief Starts a clock sync with a reference clock, such as the PC.
+ *
+ *  Records the time the sync request was answered. The reference clock then reads its time as soon as it receives
+ *  the answer, and sends it back to RTC_SyncFinish.
+ *  @return uint32_t - The low 24 bits of the time the request was answered, in 1/32768 s.
+ *  @note Assumes that the RTC module has been initialized.
+ */
+uint32_t RTC_SyncStart(void);
+
+/*! @brief Finishes a clock sync, correcting the time and the drift.
+ *
+ *  The reference time is taken to be half way through the round trip, and the clock is set to it.
+ *  Syncs at least a minute apart also measure how fast or slow the oscillator runs, which the RTC compensation register corrects.
+ *  @param reference The low 24 bits of the reference clock, in 1/32768 s.
+ *  @param offset The address of a variable to store how far the clock was behind the reference, in 1/32768 s, or NULL.
+ *  @return bool - TRUE if the clock was synchronized, FALSE if no sync was started or the round trip took too long.
+ *  @note Assumes that the RTC module has been initialized.
+ */
+bool RTC_SyncFinish(const uint32_t reference, int32_t* const offset);
+
+/*! @brief Gets the drift of the oscillator that is being compensated.
+ *
+ *  @return int32_t - The frequency error of the oscillator in parts per billion, negative when it runs slow.
+ */
+int32_t RTC_GetDrift(void);
+
+/*! @brief Sets an alarm.
+ *
+ *  The alarm is kept in a queue in order of time, and the RTC alarm register is programmed for the soonest.
+ *  An alarm that is already set is moved to its new time. An alarm set for a time that has passed goes off at once.
+ *  @param alarm The alarm, with the time, period and user callback function filled in.
+ *  @return bool - TRUE if the alarm was set.
+ *  @note Assumes that the RTC module has been initialized.
+ */
+bool RTC_AlarmSet(TRTCAlarm* const alarm);
+
+/*! @brief Cancels an alarm.
+ *
+ *  @param alarm The alarm.
+ *  @return bool - TRUE if the alarm was set and has been cancelled, FALSE if it was not set.
+ *  @note Assumes that the RTC module has been initialized.
+ */
+bool RTC_AlarmCancel(TRTCAlarm* const alarm);
+
+/*! @brief Interrupt service routine for the RTC alarm.
+ *
+ *  The alarm at the head of the queue is due, and the alarm thread will call its user callback function.
+ *  @note Assumes the RTC has been initialized.
+ */
+void __attribute__ ((interrupt)) RTC_AlarmISR(void);
+
 /*! @brief Interrupt service routine for the RTC.
  *
  *  The RTC has incremented one second.
@@ -17,92 +17,97 @@
 #include "PE_Types.h"
 #include "MK70F12.h"
 #include "SPI.h"
+#include "OS.h"
 
 //Variable to store data and commands
 uint32union_t PUSHR_DATA;
 
-/*! @brief Exhaustive search function to find PDT and DT values.
+//held while a transaction selects its slave device and exchanges its words
+static OS_ECB* BusMutex;
+
+//the prescaler and scaler values for the baud rate, indexed by the PBR and BR fields
+static const uint8_t BaudPrescalers[4] = {2, 3, 5, 7};
+static const uint16_t BaudScalers[16] = {2, 4, 6, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768};
+//the prescaler values for the delay after transfer, indexed by the PDT field, where the DT field n scales it by 2^(n+1)
+static const uint8_t DelayPrescalers[4] = {1, 3, 5, 7};
+#define NB_DELAY_SCALERS 16
+
+/*! @brief Finds the PDT and DT values for the shortest delay after transfer that is at least the delay requested.
  *
+ *  @param ctas The control and transfer attributes register to set.
+ *  @param delay The delay after transfer in nanoseconds.
  *  @param moduleClock The module clock in Hz.
- *  @return none.
+ *  @return bool - TRUE if the delay can be made, FALSE if it is longer than the longest delay.
  */
-void CalculateDelay(uint32_t moduleClock)
+static bool CalculateDelay(const uint8_t ctas, const uint32_t delay, const uint32_t moduleClock)
 {
-  //Initialisation of variables
-  uint8_t microsecondsClock;
-
+  //the delay in module clock cycles, rounded up
+  uint32_t cycles = (uint32_t)(((uint64_t)delay * moduleClock + 999999999) / 1000000000);
+  uint32_t lowestCycles = 0;
   uint8_t pdtResult = 0;
   uint8_t dtResult = 0;
-  uint16_t outcome = 0;
-  uint16_t lowestOutcome = 20000;
 
-  //All possible pdt and dt values in respective arrays
-  uint8_t pdt[] = {1,3,5,7};
-  uint32_t dt[] = {2,4,8,16,32,64,128,256,512,1024,2048,4096,8192,16384,32768,65536};
+  for (uint8_t i = 0; i < sizeof(DelayPrescalers); i++)
+    for (uint8_t j = 0; j < NB_DELAY_SCALERS; j++)
+      {
+	uint32_t candidate = (uint32_t)DelayPrescalers[i] << (j + 1);
 
-  //Module clock Hz to microseconds
-  microsecondsClock = 100000000/moduleClock;
-
-  for (uint8_t i = 0; i<sizeof(pdt); i++)
-    {
-      for (uint8_t j = 0; j<(sizeof(dt) / 4); j++)
-	{
-	  //Comparison of calculated to desired value
-	  outcome = (microsecondsClock*pdt[i]*dt[j]) - 500;
+	if (candidate >= cycles && (lowestCycles == 0 || candidate < lowestCycles))
+	  {
+	    pdtResult = i;
+	    dtResult = j;
+	    lowestCycles = candidate;
+	  }
+      }
 
-	  if (outcome < lowestOutcome)
-	    {
-	      pdtResult = i;
-	      dtResult = j;
-	      lowestOutcome = outcome;
-	    }
-	}
-    }
+  if (lowestCycles == 0)
+    return FALSE;
 
-  //Store pdt and dt resulting values into CTAR0.
-  SPI2_CTAR0 |= SPI_CTAR_PDT(pdtResult);
-  SPI2_CTAR0 |= SPI_CTAR_DT(dtResult);
+  SPI_CTAR_REG(SPI2_BASE_PTR, ctas) &= ~(SPI_CTAR_PDT_MASK | SPI_CTAR_DT_MASK);
+  SPI_CTAR_REG(SPI2_BASE_PTR, ctas) |= SPI_CTAR_PDT(pdtResult) | SPI_CTAR_DT(dtResult);
+  return TRUE;
 }
 
-/*! @brief Exhaustive search function to find PBR and BR values.
+/*! @brief Finds the PBR, BR and DBR values for the fastest SCK that is no faster than the baud rate requested.
  *
- *  @param aSPIModule is a structure containing the operating conditions for the module.
+ *  Doubling the baud rate is only used with a prescaler of 2, the only one that keeps a 50/50 duty cycle.
+ *  @param ctas The control and transfer attributes register to set.
+ *  @param baudRate The baud rate in bits/sec of the SPI clock.
  *  @param moduleClock The module clock in Hz.
- *  @return none.
+ *  @return bool - TRUE if the baud rate can be made, FALSE if it is slower than the slowest SCK.
  */
-void CalculateBaud(TSPIModule const aSPIModule, uint32_t moduleClock)
+static bool CalculateBaud(const uint8_t ctas, const uint32_t baudRate, const uint32_t moduleClock)
 {
-  //Initialisation of variables
+  //the divisor from the module clock to SCK is PBR * BR / (1 + DBR), kept here doubled so it is always whole
+  uint32_t lowestDivisor = 0;
   uint8_t pbrResult = 0;
   uint8_t brResult = 0;
-  uint8_t dbr = 0;
-  uint32_t outcome = 0;
-  uint32_t lowestOutcome = 10000000;
-
-  //All possible pbr and br values in respective arrays
-  uint8_t pbr[] = {2,3,5,7};
-  uint16_t br[] = {2,4,6,8,16,32,64,128,256,512,1024,2048,4096,8192,16384,32768};
+  uint8_t dbrResult = 0;
 
-  for (uint8_t i = 0; i < sizeof(pbr); i++)
-    {
-      for (uint8_t j = 0; j < (sizeof(br) / 2); j++)
+  for (uint8_t i = 0; i < sizeof(BaudPrescalers); i++)
+    for (uint8_t j = 0; j < sizeof(BaudScalers) / sizeof(BaudScalers[0]); j++)
+      for (uint8_t dbr = 0; dbr <= ((BaudPrescalers[i] == 2) ? 1 : 0); dbr++)
 	{
-	  //Comparison of calculated to desired value
-	  outcome = ((moduleClock * (1+dbr)) / (pbr[i] * br[j])) - aSPIModule.baudRate;
+	  uint32_t divisor = (2 * (uint32_t)BaudPrescalers[i] * BaudScalers[j]) / (1 + dbr);
 
-	  if (outcome < lowestOutcome)
+	  //SCK = 2 * moduleClock / divisor, which must not be above the baud rate
+	  if ((uint64_t)baudRate * divisor >= 2 * (uint64_t)moduleClock && (lowestDivisor == 0 || divisor < lowestDivisor))
 	    {
 	      pbrResult = i;
 	      brResult = j;
-	      lowestOutcome = outcome;
+	      dbrResult = dbr;
+	      lowestDivisor = divisor;
 	    }
 	}
-    }
 
-  //Store pdt and dt resulting values into CTAR0.
-  SPI2_CTAR0 &= ~SPI_CTAR_DBR_MASK;
-  SPI2_CTAR0 |= SPI_CTAR_PBR(pbrResult);
-  SPI2_CTAR0 |= SPI_CTAR_BR(brResult);
+  if (lowestDivisor == 0)
+    return FALSE;
+
+  SPI_CTAR_REG(SPI2_BASE_PTR, ctas) &= ~(SPI_CTAR_DBR_MASK | SPI_CTAR_PBR_MASK | SPI_CTAR_BR_MASK);
+  SPI_CTAR_REG(SPI2_BASE_PTR, ctas) |= SPI_CTAR_PBR(pbrResult) | SPI_CTAR_BR(brResult);
+  if (dbrResult)
+    SPI_CTAR_REG(SPI2_BASE_PTR, ctas) |= SPI_CTAR_DBR_MASK;
+  return TRUE;
 }
 
 
@@ -111,6 +116,8 @@ bool SPI_Init(const TSPIModule* const aSPIModule, const uint32_t moduleClock)
 
   //Utilise if statements to enable values
 
+  BusMutex = OS_SemaphoreCreate(1);
+
   //Enable SPI2, PortD and PortE clock gates (SCGC)
   SIM_SCGC3 |= SIM_SCGC3_DSPI2_MASK;
   SIM_SCGC5 |= SIM_SCGC5_PORTD_MASK; //slave in, slave out selection
@@ -135,80 +142,64 @@ bool SPI_Init(const TSPIModule* const aSPIModule, const uint32_t moduleClock)
   //Control and Transfer Attributes Registers (CTAR)
   //NOTE: CTAR should not be written while module is in running state
 
-  //Select CTAR0
-  SPI2_PUSHR |= SPI_PUSHR_CTAS(0);
-
   //MCR Configurations
   SPI2_MCR |= SPI_MCR_FRZ_MASK;
   SPI2_MCR &= ~SPI_MCR_MDIS_MASK;
   SPI2_MCR |= SPI_MCR_PCSIS(1);
-  SPI2_MCR |= SPI_MCR_DIS_TXF_MASK;
-  SPI2_MCR |= SPI_MCR_DIS_RXF_MASK;
+  //Enable the FIFOs so that words can be queued back to back, and empty them
+  SPI2_MCR &= ~(SPI_MCR_DIS_TXF_MASK | SPI_MCR_DIS_RXF_MASK);
+  SPI2_MCR |= SPI_MCR_CLR_TXF_MASK | SPI_MCR_CLR_RXF_MASK;
 
   //SPI Module configurations
-  if (aSPIModule != NULL)
+  if (aSPIModule == NULL)
+    return FALSE;
+  for (uint8_t i = 0; i < SPI_NB_CTARS; i++)
+    if (aSPIModule->ctar[i].frameSize < 4 || aSPIModule->ctar[i].frameSize > 16)
+      return FALSE;
+
+  if (aSPIModule->isMaster)
     {
-      if (aSPIModule->isMaster)
-	{
-	  //Set SPI to Master
-	  SPI2_MCR |= SPI_MCR_MSTR_MASK;
-	}
-      else
-	{
-	  SPI2_MCR &= ~SPI_MCR_MSTR_MASK;
-	}
+      //Set SPI to Master
+      SPI2_MCR |= SPI_MCR_MSTR_MASK;
+    }
+  else
+    {
+      SPI2_MCR &= ~SPI_MCR_MSTR_MASK;
+    }
 
-      if (aSPIModule->continuousClock)
-	{
-	  SPI2_MCR |= SPI_MCR_CONT_SCKE_MASK;
-	}
-      else
-	{
-	  //Disable continuous clock
-	  SPI2_MCR &= ~SPI_MCR_CONT_SCKE_MASK;
-	}
+  if (aSPIModule->continuousClock)
+    {
+      SPI2_MCR |= SPI_MCR_CONT_SCKE_MASK;
+    }
+  else
+    {
+      //Disable continuous clock
+      SPI2_MCR &= ~SPI_MCR_CONT_SCKE_MASK;
+    }
+
+  //each CTAR is a profile that a transfer selects with its CTAS field
+  for (uint8_t i = 0; i < SPI_NB_CTARS; i++)
+    {
+      const TCTAR* const ctar = &aSPIModule->ctar[i];
 
-      if (aSPIModule->inactiveHighClock)
-      	{
-	  SPI2_CTAR0 |= SPI_CTAR_CPOL_MASK;
-      	}
-      else
-      	{
-	  //Set Clock polarity to inactive low
-	  SPI2_CTAR0 &= ~SPI_CTAR_CPOL_MASK;
-      	}
-
-      if (aSPIModule->changedOnLeadingClockEdge)
-      	{
-	  SPI2_CTAR0 |= SPI_CTAR_CPHA_MASK;
-      	}
-      else
-      	{
-	  //Set data capture to leading edge
-	  SPI2_CTAR0 &= ~SPI_CTAR_CPHA_MASK;
-      	}
-
-      if (aSPIModule->LSBFirst)
-      	{
-	  SPI2_CTAR0 |= SPI_CTAR_LSBFE_MASK;
-      	}
-      else
-      	{
-	  //Set MSB first
-	  SPI2_CTAR0 &= ~SPI_CTAR_LSBFE_MASK;
-
-      	}
-
-      SPI2_CTAR0 |= SPI_CTAR_FMSZ(15);
+      SPI_CTAR_REG(SPI2_BASE_PTR, i) = SPI_CTAR_FMSZ(ctar->frameSize - 1);
 
-    }
+      if (ctar->clockPolarity == SPI_CLOCK_POLARITY_INACTIVE_HIGH)
+	SPI_CTAR_REG(SPI2_BASE_PTR, i) |= SPI_CTAR_CPOL_MASK;
 
-  //Calculate delay and baud rate to input into registers
-  CalculateDelay(moduleClock);
-  CalculateBaud(*aSPIModule, moduleClock);
+      if (ctar->clockPhase == SPI_CLOCK_PHASE_CHANGED_ON_LEADING)
+	SPI_CTAR_REG(SPI2_BASE_PTR, i) |= SPI_CTAR_CPHA_MASK;
 
-  //Set command values for PUSHR register for later use
-  PUSHR_DATA.l = 0x00010000;
+      if (ctar->firstBit == SPI_FIRST_BIT_LSB)
+	SPI_CTAR_REG(SPI2_BASE_PTR, i) |= SPI_CTAR_LSBFE_MASK;
+
+      //Calculate delay and baud rate to input into registers
+      if (!CalculateDelay(i, ctar->delayAfterTransfer, moduleClock) || !CalculateBaud(i, ctar->baudRate, moduleClock))
+	return FALSE;
+    }
+
+  //Set command values for PUSHR register for later use, the chip select that every transfer asserts
+  PUSHR_DATA.l = SPI_PUSHR_PCS(1);
 
   //Enable Module
   SPI2_MCR &= ~SPI_MCR_HALT_MASK;
@@ -218,6 +209,18 @@ bool SPI_Init(const TSPIModule* const aSPIModule, const uint32_t moduleClock)
 }
 
 
+void SPI_Lock(void)
+{
+  (void)OS_SemaphoreWait(BusMutex, 0);
+}
+
+
+void SPI_Unlock(void)
+{
+  (void)OS_SemaphoreSignal(BusMutex);
+}
+
+
 void SPI_SelectSlaveDevice(const uint8_t slaveAddress)
 {
   //GPIO 7 & 8 Masks
@@ -252,13 +255,10 @@ void SPI_SelectSlaveDevice(const uint8_t slaveAddress)
 }
 
 
-void SPI_Exchange(const uint16_t dataTx, uint16_t* const dataRx)
+void SPI_Exchange(const uint16_t dataTx, uint16_t* const dataRx, const uint8_t ctas, const bool continuousPCS)
 {
   uint16_t SPIData;
 
-  //Stores data to send
-  PUSHR_DATA.s.Lo = dataTx;
-
   //Wait until bus is idle
   while (!(SPI2_SR & SPI_SR_TFFF_MASK))
     {/*wait*/}
@@ -267,7 +267,7 @@ void SPI_Exchange(const uint16_t dataTx, uint16_t* const dataRx)
   SPI2_SR |= SPI_SR_TFFF_MASK;
 
   //Push data and command to PUSHR
-  SPI2_PUSHR = PUSHR_DATA.l;
+  SPI2_PUSHR = SPI_Command(dataTx, ctas, continuousPCS);
 
 
   //Wait until fifo is not empty
@@ -282,7 +282,56 @@ void SPI_Exchange(const uint16_t dataTx, uint16_t* const dataRx)
 
 }
 
+
+void SPI_ExchangeBatch(const uint16_t* const dataTx, uint16_t* const dataRx, const uint8_t count, const uint8_t ctas, const bool continuousPCS)
+{
+  uint8_t pushed = 0, popped = 0;
+  uint16_t SPIData;
+
+  while (popped < count)
+    {
+      //queue the next word if there is room in the FIFO, and room for what it receives
+      if (pushed < count && (uint8_t)(pushed - popped) < SPI_FIFO_SIZE && (SPI2_SR & SPI_SR_TFFF_MASK))
+	{
+	  //the last word lets the chip select go, ending the transaction
+	  SPI2_PUSHR = SPI_Command(dataTx[pushed], ctas, continuousPCS && (pushed + 1 < count));
+
+	  //w1c, it is set again while the FIFO has room
+	  SPI2_SR = SPI_SR_TFFF_MASK;
+	  pushed++;
+	}
+
+      if (SPI2_SR & SPI_SR_RFDF_MASK)
+	{
+	  SPIData = (uint16_t) SPI2_POPR;
+	  if (dataRx)
+	    dataRx[popped] = SPIData;
+
+	  //w1c, it is set again while the FIFO holds data
+	  SPI2_SR = SPI_SR_RFDF_MASK;
+	  popped++;
+	}
+    }
+}
+
+
+uint32_t SPI_Command(const uint16_t dataTx, const uint8_t ctas, const bool continuousPCS)
+{
+  return PUSHR_DATA.l | SPI_PUSHR_CTAS(ctas) | (continuousPCS ? SPI_PUSHR_CONT_MASK : 0) | dataTx;
+}
+
+
+void SPI_SetDMA(const bool enable)
+{
+  if (enable)
+    SPI2_RSER |= SPI_RSER_RFDF_RE_MASK | SPI_RSER_RFDF_DIRS_MASK;
+  else
+    SPI2_RSER &= ~(SPI_RSER_RFDF_RE_MASK | SPI_RSER_RFDF_DIRS_MASK);
+
+  SPI2_MCR |= SPI_MCR_CLR_RXF_MASK;
+  SPI2_SR = SPI_SR_RFDF_MASK;
+}
+
 /*!
 ** @}
 */
-
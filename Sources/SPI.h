@@ -18,24 +18,65 @@
 // new types
 #include "types.h"
 
+// Number of words the transmit and receive FIFOs hold
+#define SPI_FIFO_SIZE 4
+
+// Number of control and transfer attributes registers, each a profile of the clock and timing for one kind of transfer
+#define SPI_NB_CTARS 2
+
+typedef enum
+{
+  SPI_CLOCK_POLARITY_INACTIVE_LOW = 0,
+  SPI_CLOCK_POLARITY_INACTIVE_HIGH = 1
+} TSPIClockPolarity;
+
+typedef enum
+{
+  SPI_CLOCK_PHASE_CAPTURED_ON_LEADING = 0,
+  SPI_CLOCK_PHASE_CHANGED_ON_LEADING = 1
+} TSPIClockPhase;
+
+typedef enum
+{
+  SPI_FIRST_BIT_MSB = 0,
+  SPI_FIRST_BIT_LSB = 1
+} TSPIFirstBit;
+
+typedef struct
+{
+  uint8_t frameSize;                 /*!< The frame size - valid range is 4 to 16. */
+  TSPIClockPolarity clockPolarity;   /*!< The clock polarity - either inactive low or inactive high. */
+  TSPIClockPhase clockPhase;         /*!< The clock phase - either the data is changed or captured on the leading clock edge. */
+  TSPIFirstBit firstBit;             /*!< The first bit - either the data is transferred LSB first or MSB first. */
+  uint32_t delayAfterTransfer;       /*!< The delay after transfer, in nanoseconds - the shortest delay that is at least this long is used. */
+  uint32_t baudRate;                 /*!< The baud rate in bits/sec of the SPI clock - the fastest clock that is no faster than this is used. */
+} TCTAR;
+
 typedef struct
 {
   bool isMaster;                   /*!< A Boolean value indicating whether the SPI is master or slave. */
   bool continuousClock;            /*!< A Boolean value indicating whether the clock is continuous. */
-  bool inactiveHighClock;          /*!< A Boolean value indicating whether the clock is inactive low or inactive high. */
-  bool changedOnLeadingClockEdge;  /*!< A Boolean value indicating whether the data is changed or captured on the leading clock edge. */
-  bool LSBFirst;                   /*!< A Boolean value indicating whether the data is transferred LSB first or MSB first. */
-  uint32_t baudRate;               /*!< The baud rate in bits/sec of the SPI clock. */
+  TCTAR ctar[SPI_NB_CTARS];        /*!< An array of CTAR structures to initialise CTAR0 and CTAR1. */
 } TSPIModule;
 
 /*! @brief Sets up the SPI before first use.
  *
  *  @param aSPIModule is a structure containing the operating conditions for the module.
  *  @param moduleClock The module clock in Hz.
- *  @return BOOL - true if the SPI module was successfully initialized.
+ *  @return BOOL - true if the SPI module was successfully initialized, false if a frame size, delay or baud rate cannot be made.
  */
 bool SPI_Init(const TSPIModule* const aSPIModule, const uint32_t moduleClock);
  
+/*! @brief Takes the SPI for a transaction, waiting until it is free.
+ *
+ *  The slave device selected is shared, so a transaction has to select its device and exchange its words while it has the SPI.
+ */
+void SPI_Lock(void);
+
+/*! @brief Gives the SPI back after a transaction.
+ */
+void SPI_Unlock(void);
+
 /*! @brief Selects the current slave device
  *
  * @param slaveAddress The slave device address.
@@ -46,8 +87,40 @@ void SPI_SelectSlaveDevice(const uint8_t slaveAddress);
  *
  *  @param dataTx is data to transmit.
  *  @param dataRx points to where the received data will be stored.
+ *  @param ctas selects the control and transfer attributes register to use for the exchange (0 or 1).
+ *  @param continuousPCS selects whether the Peripheral Chip Select stays asserted after the transfer, until a transfer without it.
+ */
+void SPI_Exchange(const uint16_t dataTx, uint16_t* const dataRx, const uint8_t ctas, const bool continuousPCS);
+
+/*! @brief Builds the word to push for a transfer, for transfers that are pushed by DMA.
+ *
+ *  @param dataTx is data to transmit.
+ *  @param ctas selects the control and transfer attributes register to use for the transfer (0 or 1).
+ *  @param continuousPCS selects whether the Peripheral Chip Select stays asserted after the transfer.
+ *  @return uint32_t - The data with the chip select and transfer attributes, as SPI_Exchange would push it.
+ */
+uint32_t SPI_Command(const uint16_t dataTx, const uint8_t ctas, const bool continuousPCS);
+
+/*! @brief Enables or disables DMA requests to empty the receive FIFO.
+ *
+ *  The receive FIFO is emptied first.
+ *  @param enable TRUE to request DMA transfers while the receive FIFO holds data, FALSE to stop the requests.
+ */
+void SPI_SetDMA(const bool enable);
+
+/*! @brief Simultaneously transmits and receives a batch of words.
+ *
+ *  Words are pushed into the transmit FIFO while there is room, up to SPI_FIFO_SIZE words ahead of the words received,
+ *  so the words are sent back to back without waiting for each one to be received.
+ *  With a continuous Peripheral Chip Select the batch is one transaction, with the chip select asserted from the first word
+ *  until the end of the last, and no delay after transfer between the words.
+ *  @param dataTx points to the data to transmit.
+ *  @param dataRx points to where the received data will be stored, or NULL to discard it.
+ *  @param count is the number of words to exchange.
+ *  @param ctas selects the control and transfer attributes register to use for the exchange (0 or 1).
+ *  @param continuousPCS selects whether the Peripheral Chip Select stays asserted between the words.
  */
-void SPI_Exchange(const uint16_t dataTx, uint16_t* const dataRx);
+void SPI_ExchangeBatch(const uint16_t* const dataTx, uint16_t* const dataRx, const uint8_t count, const uint8_t ctas, const bool continuousPCS);
 
 #endif
 
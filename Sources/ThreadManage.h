@@ -17,9 +17,13 @@
 #define UART_RX_THREAD 1
 #define UART_TX_THREAD 2
 #define PIT_THREAD 3
-#define RTC_THREAD 4
-#define FTM_THREAD 5
-#define PACKET_THREAD 6
+#define ANALOG_THREAD 4
+#define RTC_THREAD 5
+#define FTM_THREAD 6
+#define FLASH_THREAD 7
+#define LOGGER_THREAD 8
+#define RTC_ALARM_THREAD 9
+#define PACKET_THREAD 10
 
 #define THREAD_STACK_SIZE 100
 
@@ -0,0 +1,284 @@
+/*! @file
+ *
+ *  @brief Routines for updating the firmware over the packet link.
+ *
+ *  This contains the functions for receiving a new firmware image in chunks, programming it into the
+ *  upper half of the program Flash while the current firmware keeps running, and swapping the two
+ *  halves of the Flash at the next reset.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-25
+ */
+/*!
+**  @addtogroup Update_module Update module documentation
+**  @{
+*/
+// header files used
+#include "Update.h"
+#include "Flash.h"
+#include "CRC.h"
+#include "Config.h"
+#include "EEPROM.h"
+#include "Logger.h"
+#include "MK70F12.h"
+#include "PE_Types.h"
+#include "OS.h"
+
+//Program Section programs in units of 128 bits
+#define SECTION_UNIT_SIZE 16
+//ticks to wait before a reset, so that the last packets can be sent
+#define REBOOT_DELAY 10
+
+//the image being received
+static bool Started;
+static uint32_t Length;
+static uint32_t Received;
+static uint16_t NextChunk;
+//Flash from FLASH_UPDATE_START up to here has been erased for this update
+static uint32_t ErasedEnd;
+
+//the chunk being received
+static uint8_t Chunk[UPDATE_CHUNK_SIZE];
+static uint8_t ChunkFill;
+static uint16_t ChunkNb;
+static bool ChunkStarted;
+
+/*************************function prototypes***************************/
+static bool ProgramChunk(const uint32_t address, const uint16_t length);
+
+static bool MirrorStorage(void);
+
+static void LockStorage(void);
+
+static void UnlockStorage(void);
+
+static bool IsErased(const uint32_t address);
+/***********************************************************************/
+
+bool Update_Begin(const uint32_t length)
+{
+  TFlashSwapMode mode;
+
+  Started = FALSE;
+  ChunkStarted = FALSE;
+
+  if (length == 0 || length > FLASH_IMAGE_SIZE)
+    return FALSE;
+
+  //each step moves the swap system on to the next state, starting from wherever it was left
+  if (!Flash_Swap(FLASH_SWAP_REPORT, &mode))
+    return FALSE;
+  if (mode == FLASH_SWAP_UNINITIALIZED && !Flash_Swap(FLASH_SWAP_INITIALIZE, &mode))
+    return FALSE;
+  if (mode == FLASH_SWAP_READY && !Flash_Swap(FLASH_SWAP_SET_UPDATE, &mode))
+    return FALSE;
+  if (mode == FLASH_SWAP_UPDATE && !Flash_EraseSector(FLASH_UPDATE_START + FLASH_SWAP_INDICATOR))
+    return FALSE;
+
+  //an update that is waiting for a reset to swap cannot be overwritten
+  if (!Flash_Swap(FLASH_SWAP_REPORT, &mode) || mode != FLASH_SWAP_UPDATE_ERASED)
+    return FALSE;
+
+  Length = length;
+  Received = 0;
+  NextChunk = 0;
+  ErasedEnd = FLASH_UPDATE_START;
+  Started = TRUE;
+
+  return TRUE;
+}
+
+
+bool Update_StartChunk(const uint16_t chunkNb)
+{
+  if (!Started)
+    return FALSE;
+
+  ChunkNb = chunkNb;
+  ChunkFill = 0;
+  ChunkStarted = TRUE;
+
+  return TRUE;
+}
+
+
+bool Update_Data(const uint8_t* const data, const uint8_t count)
+{
+  if (!ChunkStarted || ChunkFill + count > UPDATE_CHUNK_SIZE)
+    return FALSE;
+
+  for (uint8_t i = 0; i < count; i++)
+    Chunk[ChunkFill + i] = data[i];
+
+  ChunkFill += count;
+  return TRUE;
+}
+
+
+TUpdateStatus Update_EndChunk(const uint32_t crc)
+{
+  uint16_t length;
+
+  if (!Started || !ChunkStarted)
+    return UPDATE_NOT_STARTED;
+
+  ChunkStarted = FALSE;
+
+  //the previous chunk is sent again if its reply was lost
+  if (NextChunk && ChunkNb == NextChunk - 1)
+    return UPDATE_OK;
+  if (ChunkNb != NextChunk)
+    return UPDATE_BAD_SEQUENCE;
+
+  //only the last chunk can be short, and the packets may pad it by up to 2 bytes
+  length = (Length - Received < UPDATE_CHUNK_SIZE) ? (uint16_t)(Length - Received) : UPDATE_CHUNK_SIZE;
+  if (ChunkFill < length || ChunkFill > length + 2)
+    return UPDATE_BAD_CHUNK;
+
+  if ((CRC_Calculate(0, Chunk, length) & 0x00FFFFFF) != (crc & 0x00FFFFFF))
+    return UPDATE_BAD_CHUNK;
+
+  if (!ProgramChunk(FLASH_UPDATE_START + Received, length))
+    {
+      Started = FALSE;
+      return UPDATE_FLASH_ERROR;
+    }
+
+  Received += length;
+  NextChunk++;
+
+  return UPDATE_OK;
+}
+
+
+uint16_t Update_NextChunk(void)
+{
+  return NextChunk;
+}
+
+
+TUpdateStatus Update_Commit(const uint32_t crc)
+{
+  TFlashSwapMode mode;
+
+  if (!Started)
+    return UPDATE_NOT_STARTED;
+  if (Received != Length)
+    return UPDATE_BAD_SEQUENCE;
+
+  //the CRC is calculated over what was programmed, not what was received
+  if (CRC_Calculate(0, &_FB(FLASH_UPDATE_START), Length) != crc)
+    return UPDATE_BAD_IMAGE;
+
+  //the reset vector has to point into the image, or the tower would not start after the swap
+  if (_FW(FLASH_UPDATE_START + 4) >= FLASH_IMAGE_SIZE)
+    return UPDATE_BAD_IMAGE;
+
+  Started = FALSE;
+
+  //a write to the storage block during the copy would be lost, or copied half done
+  LockStorage();
+
+  if (!MirrorStorage() || !Flash_Swap(FLASH_SWAP_SET_COMPLETE, &mode) || mode != FLASH_SWAP_COMPLETE)
+    {
+      UnlockStorage();
+      return UPDATE_FLASH_ERROR;
+    }
+
+  return UPDATE_OK;
+}
+
+
+void Update_Reboot(void)
+{
+  OS_TimeDelay(REBOOT_DELAY);
+  SCB_AIRCR = SCB_AIRCR_VECTKEY(0x05FA) | SCB_AIRCR_SYSRESETREQ_MASK;
+
+  for (;;)
+    ;
+}
+
+/*! @brief Programs the received chunk, erasing sectors of the upper half as the image reaches them.
+ *
+ *  @param address The address to program, aligned to a 16-byte boundary.
+ *  @param length The number of bytes of the chunk that belong to the image.
+ *  @return bool - TRUE if the chunk was programmed.
+ */
+static bool ProgramChunk(const uint32_t address, const uint16_t length)
+{
+  //Program Section writes whole 128-bit units, so the end of the image is padded as erased Flash
+  uint16_t padded = (length + SECTION_UNIT_SIZE - 1) & ~(SECTION_UNIT_SIZE - 1);
+
+  for (uint16_t i = length; i < padded; i++)
+    Chunk[i] = 0xFF;
+
+  while (ErasedEnd < address + padded)
+    {
+      if (!Flash_EraseSector(ErasedEnd))
+	return FALSE;
+      ErasedEnd += FLASH_SECTOR_SIZE;
+    }
+
+  return Flash_WriteSection(address, Chunk, padded);
+}
+
+/*! @brief Copies the storage block into the other half of the Flash.
+ *
+ *  After the swap the copy appears at FLASH_STORAGE_START, so the stored data does not move.
+ *  Erased sectors are only erased in the copy, as there is nothing to program.
+ *  @return bool - TRUE if the whole block was copied.
+ */
+static bool MirrorStorage(void)
+{
+  for (uint32_t offset = 0; offset < FLASH_STORAGE_SIZE; offset += FLASH_SECTOR_SIZE)
+    {
+      uint32_t source = FLASH_STORAGE_START + offset;
+      uint32_t target = source - FLASH_HALF_SIZE;
+
+      if (!IsErased(target) && !Flash_EraseSector(target))
+	return FALSE;
+
+      if (!IsErased(source) && !Flash_WriteSection(target, (const uint8_t*)&_FB(source), FLASH_SECTOR_SIZE))
+	return FALSE;
+    }
+
+  return TRUE;
+}
+
+/*! @brief Stops every module that writes to the storage block, once it has finished what it was doing.
+ *
+ *  The logger is locked first, as it writes out its RAM batches and these can take a while.
+ */
+static void LockStorage(void)
+{
+  Logger_Lock();
+  EEPROM_Lock();
+  Config_Lock();
+}
+
+/*! @brief Lets the modules that write to the storage block go ahead again.
+ */
+static void UnlockStorage(void)
+{
+  Config_Unlock();
+  EEPROM_Unlock();
+  Logger_Unlock();
+}
+
+/*! @brief Checks whether a sector is erased.
+ *
+ *  @param address The address of the start of the sector.
+ *  @return bool - TRUE if every byte of the sector is 0xFF.
+ */
+static bool IsErased(const uint32_t address)
+{
+  for (uint32_t i = 0; i < FLASH_SECTOR_SIZE; i += 4)
+    if (_FW(address + i) != 0xFFFFFFFF)
+      return FALSE;
+
+  return TRUE;
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,96 @@
+/*! @file
+ *
+ *  @brief Routines for updating the firmware over the packet link.
+ *
+ *  This contains the functions for receiving a new firmware image in chunks, programming it into the
+ *  upper half of the program Flash while the current firmware keeps running, and swapping the two
+ *  halves of the Flash at the next reset.
+ *
+ *  @author Amir Hussein & Joseph Cerdan
+ *  @date 2018-10-25
+ */
+/*!
+**  @addtogroup Update_module Update module documentation
+**  @{
+*/
+#ifndef UPDATE_H
+#define UPDATE_H
+
+// new types
+#include "types.h"
+
+// Number of bytes of the image in each chunk, a multiple of 3 bytes per packet and of the 16-byte Program Section unit
+#define UPDATE_CHUNK_SIZE 240
+
+// The outcome of a chunk or commit
+typedef enum
+{
+  UPDATE_OK,            /*!< The chunk was programmed, or the image was committed. */
+  UPDATE_BAD_CHUNK,     /*!< The chunk was the wrong length or failed its CRC, and should be sent again. */
+  UPDATE_BAD_SEQUENCE,  /*!< The chunk is not the next one expected, or the image is incomplete. */
+  UPDATE_BAD_IMAGE,     /*!< The programmed image failed its CRC or does not start with a valid vector table. */
+  UPDATE_FLASH_ERROR,   /*!< The Flash could not be written, and the update has to be started again. */
+  UPDATE_NOT_STARTED    /*!< No update is in progress. */
+} TUpdateStatus;
+
+/*! @brief Starts receiving a new image.
+ *
+ *  Sets up the swap system if needed and puts it in the update state, ready for the upper half to be written.
+ *  An update that was started earlier but never committed is abandoned.
+ *  @param length The number of bytes in the image.
+ *  @return bool - TRUE if the update was started, FALSE if the length is not valid or the Flash is waiting for a reset to swap.
+ *  @note Assumes Flash has been initialized.
+ */
+bool Update_Begin(const uint32_t length);
+
+/*! @brief Starts receiving a chunk of the image.
+ *
+ *  @param chunkNb The position of the chunk in the image, where 0 is the first.
+ *  @return bool - TRUE if an update is in progress.
+ */
+bool Update_StartChunk(const uint16_t chunkNb);
+
+/*! @brief Adds data to the chunk being received.
+ *
+ *  @param data The data.
+ *  @param count The number of bytes of data.
+ *  @return bool - TRUE if the data fits in the chunk.
+ */
+bool Update_Data(const uint8_t* const data, const uint8_t count);
+
+/*! @brief Checks the chunk being received and programs it into Flash.
+ *
+ *  A chunk that was already programmed is accepted again without being programmed, in case its reply was lost.
+ *  @param crc The low 24 bits of the CRC-32 of the chunk.
+ *  @return TUpdateStatus - UPDATE_OK if the chunk was programmed.
+ */
+TUpdateStatus Update_EndChunk(const uint32_t crc);
+
+/*! @brief Gets the number of the next chunk to be programmed.
+ *
+ *  @return uint16_t - The position in the image of the next chunk expected.
+ */
+uint16_t Update_NextChunk(void);
+
+/*! @brief Checks the whole image and sets the Flash to swap halves at the next reset.
+ *
+ *  The storage block is copied into the other half first, so the stored data is in the same place after the swap.
+ *  The configuration, EEPROM and logger are locked for the whole copy, with the logged samples flushed first.
+ *  If the image is committed they stay locked, as nothing stored from then on would be carried over,
+ *  so the tower should be reset straight away.
+ *  @param crc The CRC-32 of the image.
+ *  @return TUpdateStatus - UPDATE_OK if the image will be run after the next reset.
+ */
+TUpdateStatus Update_Commit(const uint32_t crc);
+
+/*! @brief Resets the tower, starting the new image if an update has been committed.
+ *
+ *  Waits briefly first, so that packets already queued can be sent.
+ */
+void Update_Reboot(void);
+
+#endif
+
+/*!
+** @}
+*/
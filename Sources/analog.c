@@ -19,14 +19,33 @@
 // new types
 #include "types.h"
 #include "analog.h"
+#include "DAC.h"
 #include "PE_Types.h"
 #include "SPI.h"
+#include "PIT.h"
 #include "median.h"
+#include "CIC.h"
+#include "MK70F12.h"
+#include "OS.h"
+#include "ThreadManage.h"
 
 
-//used to determine channel 0 or 1
-#define CH_ZERO 0
-#define CH_ONE 4
+//DMA channel 1 is the one PIT channel 1 triggers, and carries the commands to the SPI
+#define DMA_COMMAND_CHANNEL 1
+//DMA channel 2 carries the results from the SPI, with the higher priority so results are never left behind
+#define DMA_RESULT_CHANNEL 2
+//DMA multiplexer sources for the SPI2 receive FIFO, and one that is always requesting so the PIT alone paces the channel
+#define DMAMUX_SOURCE_SPI2_RX 20
+#define DMAMUX_SOURCE_ALWAYS_ON 63
+
+//the ADC and the DAC each have their own clock and timing, chosen by each transfer
+#define ADC_CTAS 0
+//the fastest SCK the ADC accepts, in Hz, and the time its chip select has to stay high after a word, in nanoseconds
+#define ADC_MAX_BAUD_RATE 20000000
+#define ADC_CONVERSION_TIME 5000
+
+//the channel select bits of the command for each analog input, the odd/sign bit followed by the two select bits
+static const uint8_t Channel_Select[ANALOG_NB_INPUTS] = {0, 4, 1, 5, 2, 6, 3, 7};
 
 //used to build the data that will be sent to the analog chip
 static const uint16_t Channel_Mask = 0x8400;
@@ -35,6 +54,51 @@ static const uint8_t Analog_Address = 0x3;
 
 TAnalogInput Analog_Input[ANALOG_NB_INPUTS];
 
+//the channel of the last command sent to the ADC, whose result comes back with the next word
+static uint8_t PendingChannel;
+
+//the oversampling filter of each channel, and whether it is used
+static TCIC Oversampler[ANALOG_NB_INPUTS];
+static bool Oversampling[ANALOG_NB_INPUTS];
+
+//the acquisition engine
+static bool Acquiring;
+//how many periods of the engine there are between samples of each channel, or 0 if it is not sampled
+static uint8_t Decimation[ANALOG_NB_INPUTS];
+//the channel sampled in each slot of a frame, and the commands pushed by DMA, each sent as the result of the one before it is received
+static uint8_t SlotChannels[ANALOG_MAX_DECIMATION];
+static uint32_t Commands[ANALOG_MAX_DECIMATION];
+//the time between samples in nanoseconds
+static uint32_t Period;
+//the results, written by DMA into one half while the other half is processed, where the second half starts straight after the block in the first
+static int16_t Samples[2 * ANALOG_BLOCK_SIZE];
+static TAnalogBlock Block;
+//the half of the buffer that was filled last
+static volatile uint8_t ReadyHalf;
+
+//pointer and arguments to user call back function
+static void (*CallBack)(const TAnalogBlock* const, void*);
+static void* CallBackArgument;
+
+//thread stack
+OS_THREAD_STACK(AnalogStack, THREAD_STACK_SIZE);
+//signalled when a block is ready
+static OS_ECB* BlockReady;
+
+/*************************function prototypes***************************/
+static uint16_t ChannelCommand(const uint8_t channelNb);
+
+static uint8_t SlotCommandChannel(const uint8_t slot);
+
+static uint8_t BuildSchedule(void);
+
+static void PutSample(const uint8_t channelNb, const int16_t sample);
+
+static void FilterSample(const uint8_t channelNb, const int16_t sample);
+
+static void AnalogThread(void* arg);
+/***********************************************************************/
+
 
 /*! @brief Function to obtain and store median values
  *
@@ -44,7 +108,7 @@ TAnalogInput Analog_Input[ANALOG_NB_INPUTS];
 void getMedian(const uint8_t channelNb)
 {
   Analog_Input[channelNb].oldValue = Analog_Input[channelNb].value;
-  Analog_Input[channelNb].value.l = Median_Filter(Analog_Input[channelNb].values, (uint32_t) ANALOG_WINDOW_SIZE);
+  Analog_Input[channelNb].value.l = Median_Filter(Analog_Input[channelNb].values, (uint32_t) Analog_Input[channelNb].windowSize);
 }
 
 
@@ -63,17 +127,51 @@ bool Analog_Init(const uint32_t moduleClock)
       	}
 
       Analog_Input[i].putPtr = &Analog_Input[i].values[0];
+      Analog_Input[i].position = 0;
+      Analog_Input[i].windowSize = ANALOG_DEFAULT_WINDOW;
+      Oversampling[i] = FALSE;
+      Decimation[i] = ANALOG_DEFAULT_DECIMATION;
 
     }
 
+  Acquiring = FALSE;
+  PendingChannel = ANALOG_NO_CHANNEL;
+
+  //enable the DMA and its multiplexer for the acquisition engine
+  SIM_SCGC6 |= SIM_SCGC6_DMAMUX0_MASK;
+  SIM_SCGC7 |= SIM_SCGC7_DMA_MASK;
+
+  //set the NVIC registers for the result DMA channel
+  NVICISER0 |= NVIC_ISER_SETENA(1 << (DMA_RESULT_CHANNEL % 32));
+  NVICICPR0 |= NVIC_ICPR_CLRPEND(1 << (DMA_RESULT_CHANNEL % 32));
+
+  //create the thread
+  OS_ThreadCreate(AnalogThread, NULL, &AnalogStack[THREAD_STACK_SIZE - 1], ANALOG_THREAD);
+
+  //create semaphore
+  BlockReady = OS_SemaphoreCreate(0);
+
   //build the TSPIModule struct to send to the SPI_init
   TSPIModule SPIValues;
   SPIValues.isMaster = TRUE;
   SPIValues.continuousClock = FALSE;
-  SPIValues.inactiveHighClock = FALSE;
-  SPIValues.changedOnLeadingClockEdge = FALSE;
-  SPIValues.LSBFirst = FALSE;
-  SPIValues.baudRate = 1000000;
+
+  //the LTC1859 starts a conversion as its chip select goes high, so every word is a transfer of its own,
+  //and the chip select stays high until the conversion is done
+  SPIValues.ctar[ADC_CTAS].frameSize = 16;
+  SPIValues.ctar[ADC_CTAS].clockPolarity = SPI_CLOCK_POLARITY_INACTIVE_LOW;
+  SPIValues.ctar[ADC_CTAS].clockPhase = SPI_CLOCK_PHASE_CAPTURED_ON_LEADING;
+  SPIValues.ctar[ADC_CTAS].firstBit = SPI_FIRST_BIT_MSB;
+  SPIValues.ctar[ADC_CTAS].delayAfterTransfer = ADC_CONVERSION_TIME;
+  SPIValues.ctar[ADC_CTAS].baudRate = ADC_MAX_BAUD_RATE;
+
+  //the LTC2704 takes 32-bit words, sent as two frames with the chip select held between them
+  SPIValues.ctar[DAC_CTAS].frameSize = 16;
+  SPIValues.ctar[DAC_CTAS].clockPolarity = SPI_CLOCK_POLARITY_INACTIVE_LOW;
+  SPIValues.ctar[DAC_CTAS].clockPhase = SPI_CLOCK_PHASE_CAPTURED_ON_LEADING;
+  SPIValues.ctar[DAC_CTAS].firstBit = SPI_FIRST_BIT_MSB;
+  SPIValues.ctar[DAC_CTAS].delayAfterTransfer = DAC_LOAD_TIME;
+  SPIValues.ctar[DAC_CTAS].baudRate = DAC_MAX_BAUD_RATE;
 
   //call SPI_Init
   return SPI_Init(&SPIValues, moduleClock);
@@ -82,52 +180,415 @@ bool Analog_Init(const uint32_t moduleClock)
 
 bool Analog_Get(const uint8_t channelNb)
 {
-  static uint8_t position0 = 0, position1 = 0;
-  //data to send to the analog chip
-  uint16_t data;
+  return Analog_Scan(&channelNb, 1);
+}
+
+
+bool Analog_Scan(const uint8_t channelNbs[], const uint8_t nbChannels)
+{
+  //the ADC returns the result of the previous command with each word, so each channel's result comes back with the next word
+  uint16_t dataTx[ANALOG_NB_INPUTS + 1];
+  uint16_t dataRx[ANALOG_NB_INPUTS + 1];
+  uint8_t primed;
+
+  if (nbChannels == 0 || nbChannels > ANALOG_NB_INPUTS)
+    return FALSE;
+  for (uint8_t i = 0; i < nbChannels; i++)
+    if (channelNbs[i] >= ANALOG_NB_INPUTS)
+      return FALSE;
+
+  SPI_Lock();
+
+  //the acquisition engine and the waveform player have the SPI while they run
+  if (Acquiring || DAC_IsPlaying())
+    {
+      SPI_Unlock();
+      return FALSE;
+    }
+
+  //the last scan ended with the command for this scan's first channel, unless another scan came between,
+  //in which case the first channel's command has to be sent and its word discarded
+  primed = (PendingChannel == channelNbs[0]) ? 0 : 1;
+  if (primed)
+    dataTx[0] = ChannelCommand(channelNbs[0]);
+
+  //selecting the correct channel, one ahead of the results, and ending with the first channel of the next scan
+  for (uint8_t i = 1; i < nbChannels; i++)
+    dataTx[primed + i - 1] = ChannelCommand(channelNbs[i]);
+  dataTx[primed + nbChannels - 1] = ChannelCommand(channelNbs[0]);
+
+  SPI_SelectSlaveDevice(Analog_Address);
+
+  //perform the exchanges with the analog chip back to back
+  SPI_ExchangeBatch(dataTx, dataRx, primed + nbChannels, ADC_CTAS, FALSE);
+  PendingChannel = channelNbs[0];
+
+  SPI_Unlock();
+
+  for (uint8_t i = 0; i < nbChannels; i++)
+    {
+      FilterSample(channelNbs[i], (int16_t)dataRx[primed + i]);
+      getMedian(channelNbs[i]);
+    }
+
+  return TRUE;
+}
+
+
+bool Analog_SetWindow(const uint8_t channelNb, const uint8_t windowSize)
+{
+  if (channelNb >= ANALOG_NB_INPUTS || windowSize == 0 || windowSize > ANALOG_WINDOW_SIZE)
+    return FALSE;
 
-  SPI_SelectSlaveDevice(3);
+  //the array always holds the largest window, so a sample being put while this changes stays inside it
+  Analog_Input[channelNb].position = 0;
+  Analog_Input[channelNb].windowSize = windowSize;
 
-  if(channelNb)
-    Analog_Input[channelNb].putPtr = &Analog_Input[channelNb].values[position1];
-  else
-    Analog_Input[channelNb].putPtr = &Analog_Input[channelNb].values[position0];
+  return TRUE;
+}
 
-  //selecting the correct channel
-  switch (channelNb)
-  {
-    case 0: data = Channel_Mask | (CH_ZERO << 12);
-      break;
 
-    case 1: data = Channel_Mask | (CH_ONE << 12);
-      break;
+bool Analog_SetOversampling(const uint8_t channelNb, const uint8_t ratio, const uint8_t order)
+{
+  uint8_t ratioShift = 0;
+  bool success;
 
-    default: return FALSE;
-  }
+  if (channelNb >= ANALOG_NB_INPUTS || ratio == 0 || (ratio & (ratio - 1)))
+    return FALSE;
 
-  //perform and exchange with the analog chip
-  SPI_Exchange(data, Analog_Input[channelNb].putPtr);
+  if (ratio == 1)
+    {
+      Oversampling[channelNb] = FALSE;
+      return TRUE;
+    }
+
+  while ((1 << ratioShift) < ratio)
+    ratioShift++;
+
+  //the filter is used by the thread that takes the samples
+  OS_DisableInterrupts();
+  success = CIC_Init(&Oversampler[channelNb], order, ratioShift);
+  if (success)
+    Oversampling[channelNb] = TRUE;
+  OS_EnableInterrupts();
+
+  return success;
+}
 
-  SPI_Exchange(data, Analog_Input[channelNb].putPtr);
 
-  getMedian(channelNb);
-  if(channelNb)
+void Analog_GetOversampling(const uint8_t channelNb, uint8_t* const ratio, uint8_t* const order)
+{
+  if (channelNb >= ANALOG_NB_INPUTS || !Oversampling[channelNb])
     {
-      position1++;
-      if (position1 == 5)
-	position1 = 0;
+      *ratio = 1;
+      *order = 0;
+      return;
     }
-  else
+
+  *ratio = 1 << Oversampler[channelNb].ratioShift;
+  *order = Oversampler[channelNb].order;
+}
+
+
+bool Analog_SetDecimation(const uint8_t channelNb, const uint8_t decimation)
+{
+  uint8_t old;
+  uint16_t load = 0;
+
+  //powers of 2 interleave without ever wanting the same slot, as long as the channels fit in the frame
+  if (channelNb >= ANALOG_NB_INPUTS || decimation > ANALOG_MAX_DECIMATION || (decimation & (decimation - 1)))
+    return FALSE;
+
+  for (uint8_t i = 0; i < ANALOG_NB_INPUTS; i++)
     {
-      position0++;
-        if (position0 == 5)
-  	position0 = 0;
+      uint8_t d = (i == channelNb) ? decimation : Decimation[i];
+
+      if (d)
+	load += ANALOG_MAX_DECIMATION / d;
     }
+  //the running engine is stopped with Analog_Stop, not by taking away all of its channels
+  if (load > ANALOG_MAX_DECIMATION || (Acquiring && load == 0))
+    return FALSE;
+
+  old = Decimation[channelNb];
+  Decimation[channelNb] = decimation;
+
+  if (!Acquiring || decimation == old)
+    return TRUE;
+
+  //the scan list is built into the DMA commands, so the engine starts again from a fresh block
+  return Analog_Start(Period, CallBack, CallBackArgument);
+}
+
+
+uint8_t Analog_GetDecimation(const uint8_t channelNb)
+{
+  if (channelNb >= ANALOG_NB_INPUTS)
+    return 0;
+
+  return Decimation[channelNb];
+}
+
+
+bool Analog_Start(const uint32_t period, void (*userFunction)(const TAnalogBlock* const, void*), void* userArguments)
+{
+  uint8_t nbSlots;
+  uint16_t blockSize;
+  uint16_t dummy;
+
+  if (period < ANALOG_MIN_PERIOD)
+    return FALSE;
+
+  Analog_Stop();
+
+  nbSlots = BuildSchedule();
+  if (nbSlots == 0)
+    return FALSE;
+
+  SPI_Lock();
+
+  //the waveform player has the SPI while it runs
+  if (DAC_IsPlaying())
+    {
+      SPI_Unlock();
+      return FALSE;
+    }
+
+  //from here on Analog_Get, Analog_Scan and DAC_Put leave the SPI to the engine
+  Acquiring = TRUE;
 
+  //each result comes back with the next command, so the commands are sent one slot ahead,
+  //starting with the second slot as the first command is sent below to start the pipeline
+  for (uint8_t i = 0; i < nbSlots; i++)
+    Commands[i] = SPI_Command(ChannelCommand(SlotCommandChannel((i + 1) % nbSlots)), ADC_CTAS, FALSE);
+
+  //blocks hold whole frames, so each sample's channel is fixed by its place in the block
+  Block.nbFrames = ANALOG_BLOCK_SIZE / nbSlots;
+  Block.nbSlots = nbSlots;
+  Block.slotChannels = SlotChannels;
+  blockSize = Block.nbFrames * nbSlots;
+
+  Period = period;
+  CallBack = userFunction;
+  CallBackArgument = userArguments;
+
+  //start the first conversion, and drop the result of whatever the ADC converted before, unless the last scan already did
+  SPI_SelectSlaveDevice(Analog_Address);
+  if (PendingChannel != SlotCommandChannel(0))
+    SPI_Exchange(ChannelCommand(SlotCommandChannel(0)), &dummy, ADC_CTAS, FALSE);
+  SPI_SetDMA(TRUE);
+
+  SPI_Unlock();
+
+  //the command channel pushes one 32-bit command per trigger, and goes back to the first command after each frame
+  DMA_TCD1_SADDR = (uint32_t)&Commands[0];
+  DMA_TCD1_SOFF = sizeof(Commands[0]);
+  DMA_TCD1_ATTR = DMA_ATTR_SSIZE(2) | DMA_ATTR_DSIZE(2);
+  DMA_TCD1_NBYTES_MLNO = sizeof(Commands[0]);
+  DMA_TCD1_SLAST = -(int32_t)(nbSlots * sizeof(Commands[0]));
+  DMA_TCD1_DADDR = (uint32_t)&SPI2_PUSHR;
+  DMA_TCD1_DOFF = 0;
+  DMA_TCD1_DLASTSGA = 0;
+  DMA_TCD1_CITER_ELINKNO = DMA_CITER_ELINKNO_CITER(nbSlots);
+  DMA_TCD1_BITER_ELINKNO = DMA_BITER_ELINKNO_BITER(nbSlots);
+  DMA_TCD1_CSR = 0;
+
+  //the result channel pops one 16-bit result per request, and interrupts as each half of the buffer fills
+  DMA_TCD2_SADDR = (uint32_t)&SPI2_POPR;
+  DMA_TCD2_SOFF = 0;
+  DMA_TCD2_ATTR = DMA_ATTR_SSIZE(1) | DMA_ATTR_DSIZE(1);
+  DMA_TCD2_NBYTES_MLNO = sizeof(Samples[0]);
+  DMA_TCD2_SLAST = 0;
+  DMA_TCD2_DADDR = (uint32_t)&Samples[0];
+  DMA_TCD2_DOFF = sizeof(Samples[0]);
+  DMA_TCD2_DLASTSGA = -(int32_t)(2 * blockSize * sizeof(Samples[0]));
+  DMA_TCD2_CITER_ELINKNO = DMA_CITER_ELINKNO_CITER(2 * blockSize);
+  DMA_TCD2_BITER_ELINKNO = DMA_BITER_ELINKNO_BITER(2 * blockSize);
+  DMA_TCD2_CSR = DMA_CSR_INTHALF_MASK | DMA_CSR_INTMAJOR_MASK;
+
+  DMAMUX0_CHCFG1 = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_TRIG_MASK | DMAMUX_CHCFG_SOURCE(DMAMUX_SOURCE_ALWAYS_ON);
+  DMAMUX0_CHCFG2 = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(DMAMUX_SOURCE_SPI2_RX);
+  DMA_SERQ = DMA_SERQ_SERQ(DMA_RESULT_CHANNEL);
+  DMA_SERQ = DMA_SERQ_SERQ(DMA_COMMAND_CHANNEL);
+
+  PIT_SetTrigger(DMA_COMMAND_CHANNEL, period);
 
   return TRUE;
 }
 
+
+bool Analog_SetPeriod(const uint32_t period)
+{
+  if (!Acquiring || period < ANALOG_MIN_PERIOD)
+    return FALSE;
+
+  //the DMA only waits for the next trigger, so the PIT can be changed under it
+  Period = period;
+  PIT_SetTrigger(DMA_COMMAND_CHANNEL, period);
+
+  return TRUE;
+}
+
+
+void Analog_Stop(void)
+{
+  if (!Acquiring)
+    return;
+
+  PIT_SetTrigger(DMA_COMMAND_CHANNEL, 0);
+  DMA_CERQ = DMA_CERQ_CERQ(DMA_COMMAND_CHANNEL);
+  DMA_CERQ = DMA_CERQ_CERQ(DMA_RESULT_CHANNEL);
+  DMAMUX0_CHCFG1 = 0;
+  DMAMUX0_CHCFG2 = 0;
+
+  //let the last command finish, then drop its result so the SPI starts empty
+  while (SPI2_SR & SPI_SR_TXCTR_MASK)
+    {/*wait*/}
+  OS_TimeDelay(1);
+  SPI_SetDMA(FALSE);
+
+  //the engine leaves its own command waiting in the ADC
+  PendingChannel = ANALOG_NO_CHANNEL;
+  Acquiring = FALSE;
+}
+
+
+bool Analog_IsAcquiring(void)
+{
+  return Acquiring;
+}
+
+
+void __attribute__ ((interrupt)) Analog_ISR(void)
+{
+  OS_ISREnter();
+
+  //w1c
+  DMA_CINT = DMA_CINT_CINT(DMA_RESULT_CHANNEL);
+
+  //the DMA is now filling one half, so the other one is ready
+  ReadyHalf = (DMA_TCD2_DADDR < (uint32_t)&Samples[Block.nbFrames * Block.nbSlots]) ? 1 : 0;
+
+  (void)OS_SemaphoreSignal(BlockReady);
+  OS_ISRExit();
+}
+
+/*! @brief Builds the ADC command that selects a channel.
+ *
+ *  @param channelNb is the number of the analog input channel.
+ *  @return uint16_t - The command word.
+ */
+static uint16_t ChannelCommand(const uint8_t channelNb)
+{
+  return Channel_Mask | (Channel_Select[channelNb] << 12);
+}
+
+/*! @brief Gets the channel whose command is sent for a slot of the schedule.
+ *
+ *  An unused slot still takes a word on the SPI bus to keep the timing even, so it converts channel 0 and its result is ignored.
+ *  @param slot is the slot of the frame.
+ *  @return uint8_t - The number of the channel.
+ */
+static uint8_t SlotCommandChannel(const uint8_t slot)
+{
+  return (SlotChannels[slot] == ANALOG_NO_CHANNEL) ? 0 : SlotChannels[slot];
+}
+
+/*! @brief Builds the schedule of the acquisition engine from the decimation of each channel.
+ *
+ *  The channels are placed from the smallest decimation up, each at the first slot that is free in every one of its periods.
+ *  The slots taken so far repeat at a period that divides the decimation being placed, so the first free slot is free in all of them.
+ *  @return uint8_t - The number of slots in a frame, the largest decimation, or 0 if no channel is sampled.
+ */
+static uint8_t BuildSchedule(void)
+{
+  uint8_t nbSlots = 0;
+
+  for (uint8_t i = 0; i < ANALOG_NB_INPUTS; i++)
+    if (Decimation[i] > nbSlots)
+      nbSlots = Decimation[i];
+
+  for (uint8_t slot = 0; slot < nbSlots; slot++)
+    SlotChannels[slot] = ANALOG_NO_CHANNEL;
+
+  for (uint8_t decimation = 1; decimation <= nbSlots; decimation <<= 1)
+    for (uint8_t i = 0; i < ANALOG_NB_INPUTS; i++)
+      {
+	uint8_t offset = 0;
+
+	if (Decimation[i] != decimation)
+	  continue;
+
+	while (SlotChannels[offset] != ANALOG_NO_CHANNEL)
+	  offset++;
+
+	for (uint8_t slot = offset; slot < nbSlots; slot += decimation)
+	  SlotChannels[slot] = i;
+      }
+
+  return nbSlots;
+}
+
+/*! @brief Adds a sample to the sliding window of a channel.
+ *
+ *  @param channelNb is the number of the analog input channel.
+ *  @param sample is the sample.
+ */
+static void PutSample(const uint8_t channelNb, const int16_t sample)
+{
+  TAnalogInput* const input = &Analog_Input[channelNb];
+
+  input->putPtr = &input->values[input->position];
+  *input->putPtr = sample;
+
+  //wraps with a conditional select rather than a branch
+  input->position = (input->position + 1 < input->windowSize) ? input->position + 1 : 0;
+}
+
+/*! @brief Passes a sample through the oversampling filter of a channel, if it has one, and into its sliding window.
+ *
+ *  @param channelNb is the number of the analog input channel.
+ *  @param sample is the sample.
+ */
+static void FilterSample(const uint8_t channelNb, const int16_t sample)
+{
+  int16_t output;
+
+  if (!Oversampling[channelNb])
+    PutSample(channelNb, sample);
+  else if (CIC_Put(&Oversampler[channelNb], sample, &output))
+    PutSample(channelNb, output);
+}
+
+/*! @brief Processes each block as it is filled by the acquisition engine.
+ *
+ *  The samples of each channel go through its oversampling filter into its sliding window in the order they were taken,
+ *  and the median is taken once per block.
+ */
+static void AnalogThread(void* arg)
+{
+  for (;;)
+    {
+      (void)OS_SemaphoreWait(BlockReady, 0);
+
+      if (!Acquiring)
+	continue;
+
+      Block.samples = ReadyHalf ? &Samples[Block.nbFrames * Block.nbSlots] : &Samples[0];
+
+      for (uint16_t i = 0; i < Block.nbFrames * Block.nbSlots; i++)
+	if (SlotChannels[i % Block.nbSlots] != ANALOG_NO_CHANNEL)
+	  FilterSample(SlotChannels[i % Block.nbSlots], Block.samples[i]);
+
+      for (uint8_t i = 0; i < ANALOG_NB_INPUTS; i++)
+	if (Decimation[i])
+	  getMedian(i);
+
+      if (CallBack)
+	(*CallBack)(&Block, CallBackArgument);
+    }
+}
+
 /*!
 ** @}
 */
@@ -22,9 +22,30 @@
 #include "types.h"
 
 // Maximum number of channels
-#define ANALOG_NB_INPUTS 2
+#define ANALOG_NB_INPUTS 8
 
-#define ANALOG_WINDOW_SIZE 5
+// Largest number of samples in the sliding window of each channel, which can be changed at build time
+#ifndef ANALOG_WINDOW_SIZE
+#define ANALOG_WINDOW_SIZE 15
+#endif
+
+// Number of samples in the sliding window of each channel until it is changed
+#define ANALOG_DEFAULT_WINDOW 5
+
+// Maximum number of samples in each block taken by the acquisition engine
+#define ANALOG_BLOCK_SIZE 64
+
+// Shortest sample period in nanoseconds, the fastest the LTC1859 can convert and exchange a word
+#define ANALOG_MIN_PERIOD 10000
+
+// Largest decimation of a channel, so that a whole frame of the schedule fits in a block
+#define ANALOG_MAX_DECIMATION ANALOG_BLOCK_SIZE
+
+// Decimation of each channel until it is changed, which samples every channel in turn
+#define ANALOG_DEFAULT_DECIMATION ANALOG_NB_INPUTS
+
+// A slot of the schedule in which no channel is sampled
+#define ANALOG_NO_CHANNEL 0xFF
 
 #pragma pack(push)
 #pragma pack(2)
@@ -35,12 +56,23 @@ typedef struct
   int16union_t oldValue;               /*!< The previous "processed" analog value (the user updates this value). */
   int16_t values[ANALOG_WINDOW_SIZE];  /*!< An array of sample values to create a "sliding window". */
   int16_t* putPtr;                     /*!< A pointer into the array of the last sample taken. */
+  uint8_t position;                    /*!< The index in the array where the next sample goes. */
+  uint8_t windowSize;                  /*!< The number of samples in the sliding window, up to ANALOG_WINDOW_SIZE. */
 } TAnalogInput;
 
 #pragma pack(pop)
 
 extern TAnalogInput Analog_Input[ANALOG_NB_INPUTS];
 
+// A block of samples taken by the acquisition engine
+typedef struct
+{
+  const int16_t* samples;       /*!< The samples, one frame of the schedule after another. */
+  uint16_t nbFrames;            /*!< The number of frames in the block. */
+  uint8_t nbSlots;              /*!< The number of samples in each frame. */
+  const uint8_t* slotChannels;  /*!< The channel sampled in each slot of a frame, or ANALOG_NO_CHANNEL if the slot is unused. */
+} TAnalogBlock;
+
 /*! @brief Sets up the ADC before first use.
  *
  *  @param moduleClock The module clock rate in Hz.
@@ -50,11 +82,113 @@ bool Analog_Init(const uint32_t moduleClock);
 
 /*! @brief Takes a sample from an analog input channel.
  *
+ *  This is a scan of one channel, so sampling the same channel again takes one word on the SPI bus.
  *  @param channelNb is the number of the analog input channel to sample.
  *  @return bool - true if the channel was read successfully.
  */
 bool Analog_Get(const uint8_t channelNb);
 
+/*! @brief Takes a sample from each of several analog input channels.
+ *
+ *  The commands for all of the channels are sent to the ADC back to back, and each channel's result
+ *  comes back with the command that follows it. The scan ends with the command for its own first channel,
+ *  so the next scan of the same channels takes one word per channel, and the first channel's sample is the one
+ *  converted at the end of the scan before. Any other scan takes one extra word to start the ADC on its first channel.
+ *  @param channelNbs are the numbers of the analog input channels to sample, in the order to sample them.
+ *  @param nbChannels is the number of channels to sample, up to ANALOG_NB_INPUTS.
+ *  @return bool - true if the channels were read successfully.
+ */
+bool Analog_Scan(const uint8_t channelNbs[], const uint8_t nbChannels);
+
+/*! @brief Sets the number of samples in the sliding window of a channel.
+ *
+ *  The window starts again from its first sample, and keeps the samples already in it until they are replaced.
+ *  @param channelNb is the number of the analog input channel.
+ *  @param windowSize is the number of samples, from 1 to ANALOG_WINDOW_SIZE.
+ *  @return bool - true if the window was set.
+ */
+bool Analog_SetWindow(const uint8_t channelNb, const uint8_t windowSize);
+
+/*! @brief Sets the oversampling of a channel.
+ *
+ *  The samples of the channel are averaged by a cascaded integrator-comb filter before they go into its sliding window,
+ *  so each value in the window is made from a number of samples, with less noise. The filter starts again from empty.
+ *  @param channelNb is the number of the analog input channel.
+ *  @param ratio is the number of samples in each value, a power of 2 up to 2^CIC_MAX_RATIO_SHIFT, or 1 to put each sample in the window.
+ *  @param order is the number of filter stages, from 1 to CIC_MAX_ORDER, where higher orders reject more noise but respond more slowly.
+ *         The order times log2(ratio) can be at most CIC_MAX_GAIN_SHIFT.
+ *  @return bool - true if the oversampling was set.
+ */
+bool Analog_SetOversampling(const uint8_t channelNb, const uint8_t ratio, const uint8_t order);
+
+/*! @brief Gets the oversampling of a channel.
+ *
+ *  @param channelNb is the number of the analog input channel.
+ *  @param ratio points to where the number of samples in each value will be stored, 1 if the channel is not oversampled.
+ *  @param order points to where the number of filter stages will be stored, 0 if the channel is not oversampled.
+ */
+void Analog_GetOversampling(const uint8_t channelNb, uint8_t* const ratio, uint8_t* const order);
+
+/*! @brief Sets how often the acquisition engine samples a channel.
+ *
+ *  A channel with a decimation of N is sampled once every N periods of the engine, at evenly spaced times.
+ *  Each sample takes one period, so the sum of 1/N over all of the channels cannot be more than 1.
+ *  If the engine is running, it is restarted with the new schedule.
+ *  @param channelNb is the number of the analog input channel.
+ *  @param decimation is a power of 2 up to ANALOG_MAX_DECIMATION, or 0 to stop sampling the channel.
+ *  @return bool - true if the decimation was set, false if it is not valid or the channels would need more than every period.
+ */
+bool Analog_SetDecimation(const uint8_t channelNb, const uint8_t decimation);
+
+/*! @brief Gets how often the acquisition engine samples a channel.
+ *
+ *  @param channelNb is the number of the analog input channel.
+ *  @return uint8_t - The decimation of the channel, or 0 if it is not sampled.
+ */
+uint8_t Analog_GetDecimation(const uint8_t channelNb);
+
+/*! @brief Starts the acquisition engine.
+ *
+ *  PIT channel 1 triggers a DMA transfer of the next prebuilt ADC command to the SPI each period, and a second DMA channel
+ *  collects the results into one half of a double buffer while the other half is processed. No software runs per sample.
+ *  The commands follow a schedule built from the decimation of each channel, which repeats every frame of as many periods as the largest decimation.
+ *  When a block is complete, the analog thread updates the sliding window of each channel with its samples and calls the user callback function.
+ *  Analog_Get, Analog_Scan and the DAC cannot be used while the engine is running.
+ *  @param period is the time between samples in nanoseconds, at least ANALOG_MIN_PERIOD.
+ *  @param userFunction is a pointer to a user callback function, called with each block, or NULL.
+ *  @param userArguments is a pointer to the user arguments to use with the user callback function.
+ *  @return bool - true if the engine was started, false if the period is too short, no channel is sampled or a waveform is playing on the DAC.
+ *  @note Assumes that the PIT has been initialized.
+ */
+bool Analog_Start(const uint32_t period, void (*userFunction)(const TAnalogBlock* const, void*), void* userArguments);
+
+/*! @brief Changes the period of the running acquisition engine.
+ *
+ *  The schedule and the block being filled are kept, and the new period starts with the next sample.
+ *  @param period is the time between samples in nanoseconds, at least ANALOG_MIN_PERIOD.
+ *  @return bool - true if the period was changed, false if it is too short or the engine is not running.
+ */
+bool Analog_SetPeriod(const uint32_t period);
+
+/*! @brief Stops the acquisition engine.
+ *
+ *  Samples in a block that was not completed are discarded.
+ */
+void Analog_Stop(void);
+
+/*! @brief Checks whether the acquisition engine is running.
+ *
+ *  @return bool - true if the acquisition engine is running.
+ */
+bool Analog_IsAcquiring(void);
+
+/*! @brief Interrupt service routine for the acquisition engine DMA.
+ *
+ *  Half of the sample buffer has been filled, and the analog thread will process it.
+ *  @note Assumes the acquisition engine has been started.
+ */
+void __attribute__ ((interrupt)) Analog_ISR(void);
+
 #endif
 
 /*!
@@ -14,10 +14,33 @@
 // header files used
 #include "Flash.h"
 #include "MK70F12.h"
-#include "PE_types.h"
+#include "Cpu.h"
+#include "DWT.h"
+#include "PE_Types.h"
+#include "OS.h"
+#include "ThreadManage.h"
 
 //max amount of data to store in TFCCOB
 #define FCCOB_MAX_DATA 8
+//number of commands that can be queued with the FTFE at once
+#define FLASH_QUEUE_SIZE 4
+//Program Section programs in units of 128 bits
+#define SECTION_UNIT_SIZE 16
+//margin level used by Read 1s Section and Program Check, 1 is the user margin
+#define VERIFY_MARGIN 0x01
+//a bulk write margin checks one programmed longword in each block of this many bytes
+#define CHECK_SAMPLE_SIZE 256
+//Flash_Verify releases FlashMutex after checking each block of this many bytes
+#define VERIFY_CHUNK_SIZE 256
+#ifdef FLASH_SIM
+//the host build runs everything from ordinary memory
+#define RAM_FUNCTION
+#else
+//places a function in the .ramfunc section, which the linker file copies into m_data at startup
+#define RAM_FUNCTION __attribute__ ((section(".ramfunc"), long_call, noinline))
+#endif
+//data programmed by the benchmark, taken from the program code for a realistic mix of bits
+#define BENCH_DATA_START 0x00001000LU
 
 
 typedef struct
@@ -35,10 +58,68 @@ typedef struct
 
 } TFCCOB;
 
+typedef struct
+{
+  TFCCOB fccob;                              /*!< The command to be launched. */
+  bool success;                              /*!< TRUE if the command completed without an access error or protection violation. */
+  void (*callbackFunction)(void*, const bool); /*!< Called from the Flash thread when the command has completed. */
+  void* callbackArguments;                   /*!< The user arguments for the callback function. */
+} TFlashRequest;
+
+//queue of commands waiting for, or being executed by, the FTFE
+static TFlashRequest Queue[FLASH_QUEUE_SIZE];
+//Start is the oldest request not yet reported, Launch is the request in the FTFE, End is the next free position
+static uint8_t QueueStart, QueueLaunch, QueueEnd;
+//TRUE while the FTFE is executing a command from the queue
+static bool CommandInFlight;
+//value of the cycle counter when the command in the FTFE was launched
+static uint32_t CommandStart;
+//latency statistics of each operation
+static TFlashStats Stats[FLASH_NB_STATS];
+//TRUE if erases and writes are checked at the user margin
+static bool Verify;
+
+//stack for thread
+OS_THREAD_STACK(FlashStack, THREAD_STACK_SIZE);
+//semaphores used to manage the queue and completed commands
+static OS_ECB* SlotsAvailable;
+static OS_ECB* CommandsComplete;
+//semaphore used by a thread waiting for its own command and the mutex allowing one such thread at a time
+static OS_ECB* CommandDone;
+static OS_ECB* FlashMutex;
+
 /*************************function prototypes***************************/
+static void FlashThread(void* arg);
+
+static bool QueueCommand(const TFCCOB* commonCommandObject, void (*userFunction)(void*, const bool), void* userArguments);
+
+static void RAM_FUNCTION StartCommand(const TFCCOB* commonCommandObject);
+
+static bool RAM_FUNCTION RunFromRAM(const TFCCOB* commonCommandObject, uint8_t* const result);
+
+static void CommandComplete(void* result, const bool success);
+
+static void CheckComplete(void* passed, const bool success);
+
 static bool LaunchCommand(const TFCCOB* commonCommandObject);
 
-static bool EraseSector(void);
+static bool ExecuteCommand(const TFCCOB* commonCommandObject);
+
+static bool WriteSection(const uint32_t address, const uint8_t* const data, const uint16_t length);
+
+static bool EraseSector(const uint32_t address);
+
+static bool CheckErased(const uint32_t address);
+
+static bool CheckProgram(const uint32_t address, const uint8_t* const data, const uint32_t length);
+
+static bool CheckSection(const uint32_t address, const uint8_t* const data, const uint32_t length);
+
+static void LoadReadOnes(TFCCOB* const commonCommandObject, const uint32_t address, const uint16_t units);
+
+static uint32_t LoadProgramCheck(TFCCOB* const commonCommandObject, const uint32_t address, const uint8_t* const data);
+
+static void BatchCheck(TFCCOB* const last, const TFCCOB* const next, bool* const pending, bool* const passed);
 
 static bool WritePhrase(const uint32_t address, const uint64_t phrase);
 
@@ -47,10 +128,46 @@ static bool ModifyPhrase(const uint32_t address, const uint64_t phrase);
 static bool LoadData(TFCCOB* commonCommandObject, const uint64_t data);
 
 static bool LoadAddress(uint32_t address, TFCCOB* commonCommandObject);
+
+static void RAM_FUNCTION RecordLatency(const TFlashStatsType type, const uint32_t cycles);
+
+static void ClearStats(const TFlashStatsType type);
 /***********************************************************************/
 
 bool Flash_Init(void)
 {
+  //Turns off any stale Flash Access Error Flag and Flash Protection Violation Flag
+  FTFE_FSTAT = FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK;
+  //the command complete interrupt is only enabled while a command is in flight
+  FTFE_FCNFG &= ~FTFE_FCNFG_CCIE_MASK;
+
+  QueueStart = 0;
+  QueueLaunch = 0;
+  QueueEnd = 0;
+  CommandInFlight = FALSE;
+  Verify = FALSE;
+
+  //not Flash_ResetStats, whose critical section would enable interrupts in the middle of the start-up
+  for (uint8_t i = 0; i < FLASH_NB_STATS; i++)
+    ClearStats((TFlashStatsType)i);
+
+  //start the cycle counter used to time each command
+  DEMCR |= DEMCR_TRCENA_MASK;
+  DWT_CTRL |= DWT_CTRL_CYCCNTENA_MASK;
+
+  //set the NVIC registers
+  NVICISER0 |= NVIC_ISER_SETENA(1 << (18 % 32));
+  NVICICPR0 |= NVIC_ICPR_CLRPEND(1 << (18 % 32));
+
+  //create semaphores
+  SlotsAvailable = OS_SemaphoreCreate(FLASH_QUEUE_SIZE);
+  CommandsComplete = OS_SemaphoreCreate(0);
+  CommandDone = OS_SemaphoreCreate(0);
+  FlashMutex = OS_SemaphoreCreate(1);
+
+  //create the thread
+  OS_ThreadCreate(FlashThread, NULL, &FlashStack[THREAD_STACK_SIZE - 1], FLASH_THREAD);
+
   return TRUE;
 }
 
@@ -190,7 +307,342 @@ bool Flash_Write8(volatile uint8_t* const address, const uint8_t data)
 
 bool Flash_Erase(void)
 {
-  return EraseSector();
+  return EraseSector(FLASH_DATA_START);
+}
+
+
+bool Flash_EraseSector(const uint32_t address)
+{
+  if (address < FLASH_WRITABLE_START || (address % FLASH_SECTOR_SIZE))
+    return FALSE;
+
+  return EraseSector(address);
+}
+
+
+bool Flash_WritePhrase(const uint32_t address, const uint64_t phrase)
+{
+  if (address < FLASH_WRITABLE_START || (address % 8))
+    return FALSE;
+
+  return WritePhrase(address, phrase);
+}
+
+
+bool Flash_EraseSectorAsync(const uint32_t address, void (*userFunction)(void*, const bool), void* userArguments)
+{
+  TFCCOB fccob;
+
+  if (address < FLASH_WRITABLE_START || (address % FLASH_SECTOR_SIZE))
+    return FALSE;
+
+  fccob.command = 0x09;
+  LoadAddress(address, &fccob);
+  return QueueCommand(&fccob, userFunction, userArguments);
+}
+
+
+bool Flash_WritePhraseAsync(const uint32_t address, const uint64_t phrase, void (*userFunction)(void*, const bool), void* userArguments)
+{
+  TFCCOB fccob;
+
+  if (address < FLASH_WRITABLE_START || (address % 8))
+    return FALSE;
+
+  fccob.command = 0x07;
+  LoadAddress(address, &fccob);
+  LoadData(&fccob, phrase);
+  return QueueCommand(&fccob, userFunction, userArguments);
+}
+
+
+bool Flash_WriteSection(const uint32_t address, const uint8_t* const data, const uint32_t length)
+{
+  uint32_t done = 0;
+  bool success = TRUE;
+
+  //the FTFE programs sections in whole 128-bit units
+  if (address < FLASH_WRITABLE_START || (address % SECTION_UNIT_SIZE) || (length % SECTION_UNIT_SIZE) || data == NULL)
+    return FALSE;
+
+  //the FlexRAM is shared with anyone else launching commands, so hold the mutex while it is staged and programmed
+  (void)OS_SemaphoreWait(FlashMutex, 0);
+
+  //a section cannot cross a sector boundary, so split the data at each one
+  while (success && done < length)
+    {
+      uint32_t chunk = FLASH_SECTOR_SIZE - ((address + done) % FLASH_SECTOR_SIZE);
+
+      if (chunk > length - done)
+	chunk = length - done;
+      if (chunk > FLASH_FLEXRAM_SIZE)
+	chunk = FLASH_FLEXRAM_SIZE;
+
+      success = WriteSection(address + done, &data[done], (uint16_t)chunk);
+      //each section is checked once, straight after it has been programmed
+      if (success && Verify)
+	success = CheckSection(address + done, &data[done], chunk);
+      done += chunk;
+    }
+
+  (void)OS_SemaphoreSignal(FlashMutex);
+  return success;
+}
+
+
+bool Flash_Verify(const uint32_t address, const uint8_t* const data, const uint32_t length)
+{
+  bool success = TRUE;
+
+  if (address < FLASH_WRITABLE_START || (address % 4) || (length % 4) || data == NULL)
+    return FALSE;
+
+  //a long check would hold up every other writer, so the mutex is released between chunks
+  for (uint32_t done = 0; success && done < length; done += VERIFY_CHUNK_SIZE)
+    {
+      uint32_t chunk = (length - done < VERIFY_CHUNK_SIZE) ? length - done : VERIFY_CHUNK_SIZE;
+
+      (void)OS_SemaphoreWait(FlashMutex, 0);
+      success = CheckProgram(address + done, &data[done], chunk);
+      (void)OS_SemaphoreSignal(FlashMutex);
+    }
+
+  return success;
+}
+
+
+void Flash_SetVerify(const bool enable)
+{
+  Verify = enable;
+}
+
+
+bool Flash_IsVerifying(void)
+{
+  return Verify;
+}
+
+
+bool Flash_Swap(const uint8_t control, TFlashSwapMode* const mode)
+{
+  TFCCOB fccob;
+  uint8_t result;
+  bool success;
+
+  fccob.command = 0x46;
+  LoadAddress(FLASH_SWAP_INDICATOR, &fccob);
+  LoadData(&fccob, 0);
+  //the swap control code goes in FCCOB4
+  fccob.data[3] = control;
+
+  (void)OS_SemaphoreWait(FlashMutex, 0);
+
+  //the command bypasses the queue, so wait until the queue is idle with interrupts disabled
+  for (;;)
+    {
+      OS_DisableInterrupts();
+      if (!CommandInFlight)
+	break;
+      OS_EnableInterrupts();
+      OS_TimeDelay(1);
+    }
+
+  success = RunFromRAM(&fccob, &result);
+  OS_EnableInterrupts();
+
+  (void)OS_SemaphoreSignal(FlashMutex);
+
+  *mode = (TFlashSwapMode)result;
+  return success;
+}
+
+
+bool Flash_GetStats(const TFlashStatsType type, TFlashStats* const stats)
+{
+  if (type >= FLASH_NB_STATS || stats == NULL)
+    return FALSE;
+
+  //critical section as the ISR updates the statistics
+  OS_DisableInterrupts();
+  *stats = Stats[type];
+  OS_EnableInterrupts();
+
+  return TRUE;
+}
+
+
+bool Flash_ResetStats(const TFlashStatsType type)
+{
+  if (type >= FLASH_NB_STATS)
+    return FALSE;
+
+  //critical section as the ISR updates the statistics
+  OS_DisableInterrupts();
+  ClearStats(type);
+  OS_EnableInterrupts();
+
+  return TRUE;
+}
+
+
+bool Flash_Benchmark(const uint8_t cycles, const bool section, uint32_t* const microseconds)
+{
+  uint64_t total = 0;
+
+  if (cycles == 0 || microseconds == NULL)
+    return FALSE;
+
+  for (uint8_t i = 0; i < cycles; i++)
+    {
+      uint32_t start = DWT_CYCCNT;
+      bool success = EraseSector(FLASH_BENCH_SECTOR);
+
+      if (section)
+	success = success && Flash_WriteSection(FLASH_BENCH_SECTOR, (const uint8_t*)&_FB(BENCH_DATA_START), FLASH_SECTOR_SIZE);
+      else
+	for (uint32_t offset = 0; success && offset < FLASH_SECTOR_SIZE; offset += 8)
+	  success = WritePhrase(FLASH_BENCH_SECTOR + offset, _FP(BENCH_DATA_START + offset));
+
+      if (!success)
+	return FALSE;
+
+      total += (DWT_CYCCNT - start) / CYCLES_PER_US;
+    }
+
+  *microseconds = (uint32_t)(total / cycles);
+  return TRUE;
+}
+
+
+void __attribute__ ((interrupt)) RAM_FUNCTION Flash_ISR(void)
+{
+  OS_ISREnter();
+
+  if (CommandInFlight && (FTFE_FSTAT & FTFE_FSTAT_CCIF_MASK))
+    {
+      uint32_t cycles = DWT_CYCCNT - CommandStart;
+
+      //record the outcome of the command that has just finished, including a failed erase or program verify
+      Queue[QueueLaunch].success = !(FTFE_FSTAT & (FTFE_FSTAT_FPVIOL_MASK | FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_MGSTAT0_MASK));
+
+      //rejected commands finish at once, so only time those that ran
+      if (Queue[QueueLaunch].success)
+	switch (Queue[QueueLaunch].fccob.command)
+	{
+	  case 0x09:
+	    RecordLatency(FLASH_STATS_ERASE, cycles);
+	    break;
+	  case 0x07:
+	    RecordLatency(FLASH_STATS_PHRASE, cycles);
+	    break;
+	  case 0x0B:
+	    RecordLatency(FLASH_STATS_SECTION, cycles);
+	    break;
+	  case 0x01:
+	  case 0x02:
+	    RecordLatency(FLASH_STATS_VERIFY, cycles);
+	    break;
+	}
+
+      QueueLaunch++;
+      if (QueueLaunch > FLASH_QUEUE_SIZE - 1)
+	QueueLaunch = 0;
+
+      //launch the next queued command, or stop interrupting if there is none
+      if (QueueLaunch != QueueEnd)
+	StartCommand(&Queue[QueueLaunch].fccob);
+      else
+	{
+	  CommandInFlight = FALSE;
+	  FTFE_FCNFG &= ~FTFE_FCNFG_CCIE_MASK;
+	}
+
+      (void)OS_SemaphoreSignal(CommandsComplete);
+    }
+  else
+    FTFE_FCNFG &= ~FTFE_FCNFG_CCIE_MASK;
+
+  OS_ISRExit();
+}
+
+/*! @brief Reports completed commands to their callers in the order they were queued.
+ *
+ *  @param arg Unused.
+ */
+static void FlashThread(void* arg)
+{
+  for (;;)
+    {
+      (void)OS_SemaphoreWait(CommandsComplete, 0);
+
+      TFlashRequest* const request = &Queue[QueueStart];
+
+      if (request->callbackFunction)
+	(*request->callbackFunction)(request->callbackArguments, request->success); //calls the user call back function
+
+      QueueStart++;
+      if (QueueStart > FLASH_QUEUE_SIZE - 1)
+	QueueStart = 0;
+
+      (void)OS_SemaphoreSignal(SlotsAvailable);
+    }
+}
+
+/*! @brief Places a command in the queue and launches it if the FTFE is idle.
+ *
+ *  @param commonCommandObject The command to queue.
+ *  @param userFunction is a pointer to a function called from the Flash thread once the command has completed.
+ *  @param userArguments is a pointer to the user arguments to use with the callback function.
+ *  @return bool - TRUE if the command was queued.
+ *  @note Blocks while the queue is full.
+ */
+static bool QueueCommand(const TFCCOB* commonCommandObject, void (*userFunction)(void*, const bool), void* userArguments)
+{
+  (void)OS_SemaphoreWait(SlotsAvailable, 0);
+
+  //critical section as the ISR also moves through the queue
+  OS_DisableInterrupts();
+
+  Queue[QueueEnd].fccob = *commonCommandObject;
+  Queue[QueueEnd].success = FALSE;
+  Queue[QueueEnd].callbackFunction = userFunction;
+  Queue[QueueEnd].callbackArguments = userArguments;
+
+  QueueEnd++;
+  if (QueueEnd > FLASH_QUEUE_SIZE - 1)
+    QueueEnd = 0;
+
+  if (!CommandInFlight)
+    {
+      CommandInFlight = TRUE;
+      StartCommand(&Queue[QueueLaunch].fccob);
+      FTFE_FCNFG |= FTFE_FCNFG_CCIE_MASK;
+    }
+
+  OS_EnableInterrupts();
+  return TRUE;
+}
+
+/*! @brief Called from the Flash thread when a command launched by LaunchCommand has completed.
+ *
+ *  @param result Pointer to the waiting thread's result.
+ *  @param success TRUE if the command completed without an error.
+ */
+static void CommandComplete(void* result, const bool success)
+{
+  *(bool*)result = success;
+  (void)OS_SemaphoreSignal(CommandDone);
+}
+
+/*! @brief Called from the Flash thread when one of a batch of checks has completed.
+ *
+ *  @param passed Pointer to the waiting thread's result, cleared if the check failed.
+ *  @param success TRUE if the data read back correctly.
+ */
+static void CheckComplete(void* passed, const bool success)
+{
+  if (!success)
+    *(bool*)passed = FALSE;
 }
 
 /*! @brief Calls the relevant functions to modify the flash.
@@ -202,42 +654,267 @@ bool Flash_Erase(void)
  */
 static bool ModifyPhrase(const uint32_t address, const uint64_t phrase)
 {
+  uint32_t start = DWT_CYCCNT;
+  bool success = FALSE;
+
   if (Flash_Erase()) //only writes in the data if the flash was erased successfully
-    return WritePhrase(address, phrase);
+    success = WritePhrase(address, phrase);
 
-  return FALSE;
+  //critical section as the ISR also records latencies
+  if (success)
+    {
+      OS_DisableInterrupts();
+      RecordLatency(FLASH_STATS_MODIFY, DWT_CYCCNT - start);
+      OS_EnableInterrupts();
+    }
+
+  return success;
 }
 
 /*! @brief Erases a Sector of the Flash
  *
+ *  @param address The address of the start of the sector.
  *  @return bool - TRUE if Flash sector was erased
  *  @note Assumes Flash has been initialized.
  */
-static bool EraseSector(void)
+static bool EraseSector(const uint32_t address)
 {
-  uint32_t address = FLASH_DATA_START;
   TFCCOB fccob;
 
   //loads the command and address in fccob struct, then calls launch command to execute the steps
   fccob.command = 0x09;
   LoadAddress(address, &fccob);
+  if (!LaunchCommand(&fccob))
+    return FALSE;
+
+  return !Verify || CheckErased(address);
+}
+
+/*! @brief Checks every bit of a sector reads as erased at the user margin, with a single Read 1s Section command.
+ *
+ *  @param address The address of the start of the sector.
+ *  @return bool - TRUE if the whole sector is erased.
+ */
+static bool CheckErased(const uint32_t address)
+{
+  TFCCOB fccob;
+
+  LoadReadOnes(&fccob, address, FLASH_SECTOR_SIZE / SECTION_UNIT_SIZE);
   return LaunchCommand(&fccob);
 }
 
+/*! @brief Checks programmed data at the user margin with Program Check commands.
+ *
+ *  A normal read of the whole range is done first, as it is cheap and catches outright failures.
+ *  The margin checks are then queued back to back, and only the last one is waited for.
+ *  @param address The 4-byte aligned address of the data.
+ *  @param data The data that should be in the Flash.
+ *  @param length The number of bytes to check, a multiple of 4.
+ *  @return bool - TRUE if every longword reads back correctly.
+ *  @note Assumes the caller holds FlashMutex.
+ */
+static bool CheckProgram(const uint32_t address, const uint8_t* const data, const uint32_t length)
+{
+  TFCCOB fccob, last;
+  bool passed = TRUE, pending = FALSE;
+
+  for (uint32_t i = 0; i < length; i++)
+    if (_FB(address + i) != data[i])
+      return FALSE;
+
+  //erased longwords were not programmed, so there is nothing to check
+  for (uint32_t i = 0; i < length; i += 4)
+    if (LoadProgramCheck(&fccob, address + i, &data[i]) != 0xFFFFFFFF)
+      BatchCheck(&last, &fccob, &pending, &passed);
+
+  if (pending && !ExecuteCommand(&last))
+    passed = FALSE;
+
+  return passed;
+}
+
+/*! @brief Checks a freshly programmed section at the user margin without a command per longword.
+ *
+ *  After a normal read of the whole section, each run of erased 128-bit units is checked with one
+ *  Read 1s Section command, and the first programmed longword in each CHECK_SAMPLE_SIZE block is
+ *  checked with Program Check. This is at most 32 commands for a sector, where CheckProgram can take 1024.
+ *  @param address The 128-bit aligned address of the section.
+ *  @param data The data that was programmed.
+ *  @param length The number of bytes in the section, a multiple of 16 that does not cross a sector boundary.
+ *  @return bool - TRUE if the section reads back correctly.
+ *  @note Assumes the caller holds FlashMutex.
+ */
+static bool CheckSection(const uint32_t address, const uint8_t* const data, const uint32_t length)
+{
+  TFCCOB fccob, last;
+  uint16_t run = 0;
+  bool passed = TRUE, pending = FALSE;
+
+  for (uint32_t i = 0; i < length; i++)
+    if (_FB(address + i) != data[i])
+      return FALSE;
+
+  //the end of the section closes the last run
+  for (uint32_t i = 0; i <= length; i += SECTION_UNIT_SIZE)
+    {
+      bool erased = (i < length);
+
+      for (uint8_t j = 0; erased && j < SECTION_UNIT_SIZE; j++)
+	erased = (data[i + j] == 0xFF);
+
+      if (erased)
+	run++;
+      else if (run)
+	{
+	  LoadReadOnes(&fccob, address + i - run * SECTION_UNIT_SIZE, run);
+	  BatchCheck(&last, &fccob, &pending, &passed);
+	  run = 0;
+	}
+    }
+
+  for (uint32_t i = 0; i < length; i += CHECK_SAMPLE_SIZE)
+    for (uint32_t j = i; j < i + CHECK_SAMPLE_SIZE && j < length; j += 4)
+      if (LoadProgramCheck(&fccob, address + j, &data[j]) != 0xFFFFFFFF)
+	{
+	  BatchCheck(&last, &fccob, &pending, &passed);
+	  break;
+	}
+
+  if (pending && !ExecuteCommand(&last))
+    passed = FALSE;
+
+  return passed;
+}
+
+/*! @brief Loads a Read 1s Section command at the user margin.
+ *
+ *  @param commonCommandObject The command to load.
+ *  @param address The 128-bit aligned address of the first unit.
+ *  @param units The number of 128-bit units to check.
+ */
+static void LoadReadOnes(TFCCOB* const commonCommandObject, const uint32_t address, const uint16_t units)
+{
+  commonCommandObject->command = 0x01;
+  LoadAddress(address, commonCommandObject);
+  LoadData(commonCommandObject, 0);
+  //the number of 128-bit units goes in FCCOB4 and FCCOB5, the margin level in FCCOB6
+  commonCommandObject->data[3] = (uint8_t)(units >> 8);
+  commonCommandObject->data[2] = (uint8_t)units;
+  commonCommandObject->data[1] = VERIFY_MARGIN;
+}
+
+/*! @brief Loads a Program Check command at the user margin.
+ *
+ *  @param commonCommandObject The command to load.
+ *  @param address The 4-byte aligned address of the longword.
+ *  @param data The four bytes that should be at the address.
+ *  @return uint32_t - The expected longword, 0xFFFFFFFF if it is erased and there is nothing to check.
+ */
+static uint32_t LoadProgramCheck(TFCCOB* const commonCommandObject, const uint32_t address, const uint8_t* const data)
+{
+  uint32_t expected = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+
+  //the expected data goes in FCCOB8 to FCCOBB, the margin level in FCCOB4
+  commonCommandObject->command = 0x02;
+  LoadAddress(address, commonCommandObject);
+  LoadData(commonCommandObject, (uint64_t)expected << 32);
+  commonCommandObject->data[3] = VERIFY_MARGIN;
+  return expected;
+}
+
+/*! @brief Adds a check to a batch, queueing the one before it.
+ *
+ *  Checks are reported in order, so the caller only waits for the last one with ExecuteCommand
+ *  and once it has completed so have all the others.
+ *  @param last The check held back as the last of the batch.
+ *  @param next The check to add.
+ *  @param pending TRUE once last holds a check.
+ *  @param passed The batch result, cleared by CheckComplete if a queued check fails.
+ *  @note Assumes the caller holds FlashMutex.
+ */
+static void BatchCheck(TFCCOB* const last, const TFCCOB* const next, bool* const pending, bool* const passed)
+{
+  if (*pending)
+    (void)QueueCommand(last, CheckComplete, passed);
+
+  *last = *next;
+  *pending = TRUE;
+}
+
 /*! @brief Executes a command to do something to the flash
  *
+ *  The calling thread sleeps until the FTFE reports the command complete, allowing other threads to run.
  *  @param commonCommandObject to a TFCCOB variable with all information required to load the CCOB registers
  *  @return bool - TRUE if command was successfully executed
- *  @note Assumes Flash has been initialized.
+ *  @note Assumes Flash has been initialized and interrupts are enabled.
  */
 static bool LaunchCommand(const TFCCOB* commonCommandObject)
 {
-  for (;;)
-    {
-      if (FTFE_FSTAT & FTFE_FSTAT_CCIF_MASK) //check if the previous command is done executing
-	break;
-    }
+  bool success;
+
+  //only one thread at a time can wait on CommandDone
+  (void)OS_SemaphoreWait(FlashMutex, 0);
+  success = ExecuteCommand(commonCommandObject);
+  (void)OS_SemaphoreSignal(FlashMutex);
+
+  return success;
+}
 
+/*! @brief Queues a command and sleeps until it has completed.
+ *
+ *  @param commonCommandObject to a TFCCOB variable with all information required to load the CCOB registers
+ *  @return bool - TRUE if command was successfully executed
+ *  @note Assumes the caller holds FlashMutex.
+ */
+static bool ExecuteCommand(const TFCCOB* commonCommandObject)
+{
+  bool success = FALSE;
+
+  if (QueueCommand(commonCommandObject, CommandComplete, &success))
+    (void)OS_SemaphoreWait(CommandDone, 0);
+
+  return success;
+}
+
+/*! @brief Stages data in the FlexRAM and programs it with a single Program Section command.
+ *
+ *  @param address The 128-bit aligned address to program.
+ *  @param data The data to program.
+ *  @param length The number of bytes to program, a multiple of 16 that does not cross a sector boundary.
+ *  @return bool - TRUE if the section was programmed, FALSE if the FlexRAM is unavailable or there is a programming error.
+ *  @note Assumes the caller holds FlashMutex.
+ */
+static bool WriteSection(const uint32_t address, const uint8_t* const data, const uint16_t length)
+{
+  TFCCOB fccob;
+  uint16_t units = length / SECTION_UNIT_SIZE;
+
+  //the FlexRAM can only stage data while it is configured as RAM
+  if (!(FTFE_FCNFG & FTFE_FCNFG_RAMRDY_MASK))
+    return FALSE;
+
+  for (uint16_t i = 0; i < length; i++)
+    _FB(FLASH_FLEXRAM_START + i) = data[i];
+
+  fccob.command = 0x0B;
+  LoadAddress(address, &fccob);
+  LoadData(&fccob, 0);
+  //the number of 128-bit units goes in FCCOB4 (high byte) and FCCOB5 (low byte)
+  fccob.data[3] = (uint8_t)(units >> 8);
+  fccob.data[2] = (uint8_t)units;
+
+  return ExecuteCommand(&fccob);
+}
+
+/*! @brief Loads the CCOB registers and launches a command.
+ *
+ *  Runs from RAM so that no instruction fetch from the program Flash is needed
+ *  between launching the command and returning.
+ *  @param commonCommandObject to a TFCCOB variable with all information required to load the CCOB registers
+ *  @note Assumes the previous command has completed (CCIF is set).
+ */
+static void RAM_FUNCTION StartCommand(const TFCCOB* commonCommandObject)
+{
   //Turns off the Flash Access Error Flag and Flash Protection Violation Flag by writing 1
   FTFE_FSTAT = FTFE_FSTAT_ACCERR_MASK;
   FTFE_FSTAT = FTFE_FSTAT_FPVIOL_MASK;
@@ -259,18 +936,34 @@ static bool LaunchCommand(const TFCCOB* commonCommandObject)
   FTFE_FCCOB8 = commonCommandObject->data[7];
 
   // set ccif bit to 0 to launch the command
+  CommandStart = DWT_CYCCNT;
   FTFE_FSTAT = FTFE_FSTAT_CCIF_MASK;
+#ifdef FLASH_SIM
+  FlashSim_Launch();
+#endif
+}
+
+/*! @brief Launches a command and waits for it to complete without leaving RAM.
+ *
+ *  Used for commands that can program the block the program runs from, where no instruction
+ *  may be fetched from Flash until the command has completed.
+ *  @param commonCommandObject to a TFCCOB variable with all information required to load the CCOB registers
+ *  @param result Set to the value the command returns in FCCOB5.
+ *  @return bool - TRUE if the command completed without error.
+ *  @note Assumes interrupts are disabled and no queued command is in flight.
+ */
+static bool RAM_FUNCTION RunFromRAM(const TFCCOB* commonCommandObject, uint8_t* const result)
+{
+  StartCommand(commonCommandObject);
 
-  for (;;)//waits for the command execution to complete
-      {
-        if (FTFE_FSTAT & FTFE_FSTAT_CCIF_MASK)
-          {
-	    if (FTFE_FSTAT & FTFE_FSTAT_FPVIOL_MASK || FTFE_FSTAT & FTFE_FSTAT_ACCERR_MASK)
-	      return FALSE;
+#ifdef FLASH_SIM
+  FlashSim_Finish();
+#endif
+  while (!(FTFE_FSTAT & FTFE_FSTAT_CCIF_MASK))
+    ;
 
-	    return TRUE;
-          }
-      }
+  *result = FTFE_FCCOB5;
+  return !(FTFE_FSTAT & (FTFE_FSTAT_FPVIOL_MASK | FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_MGSTAT0_MASK));
 }
 
 /*! @brief Writes 64-bits to a sector of the Flash
@@ -283,12 +976,21 @@ static bool LaunchCommand(const TFCCOB* commonCommandObject)
 static bool WritePhrase(const uint32_t address, const uint64_t phrase)
 {
   TFCCOB fccob;
+  bool success;
+
   //loading the fccob variable with the command, address and data.
   fccob.command = 0x07;
   LoadAddress(address, &fccob);
   LoadData(&fccob, phrase);
 
-  return LaunchCommand(&fccob);
+  //the mutex is held until the phrase has been checked
+  (void)OS_SemaphoreWait(FlashMutex, 0);
+  success = ExecuteCommand(&fccob);
+  if (success && Verify)
+    success = CheckProgram(address, (const uint8_t*)&phrase, 8);
+  (void)OS_SemaphoreSignal(FlashMutex);
+
+  return success;
 }
 
 /*! @brief Loads the address into the TFCCOB variable
@@ -320,6 +1022,47 @@ static bool LoadData(TFCCOB* commonCommandObject, const uint64_t data)
  return TRUE;
 }
 
+/*! @brief Adds the latency of an operation to its statistics.
+ *
+ *  Runs from RAM as it is called by Flash_ISR.
+ *  @param type The operation.
+ *  @param cycles The latency in core clock cycles.
+ *  @note Assumes interrupts are disabled or the caller is the Flash ISR.
+ */
+static void RAM_FUNCTION RecordLatency(const TFlashStatsType type, const uint32_t cycles)
+{
+  TFlashStats* const stats = &Stats[type];
+  uint32_t microseconds = cycles / CYCLES_PER_US;
+  //bin n holds latencies of 2^n to 2^(n+1) - 1 us, with anything longer in the last bin
+  uint8_t bin = 31 - __builtin_clz(microseconds | 1);
+
+  if (bin > FLASH_HISTOGRAM_SIZE - 1)
+    bin = FLASH_HISTOGRAM_SIZE - 1;
+
+  stats->count++;
+  stats->total += microseconds;
+  if (microseconds < stats->min)
+    stats->min = microseconds;
+  if (microseconds > stats->max)
+    stats->max = microseconds;
+  if (stats->histogram[bin] < 0xFFFF)
+    stats->histogram[bin]++;
+}
+
+/*! @brief Clears the latency statistics of an operation.
+ *
+ *  @param type The operation.
+ *  @note Assumes the caller has disabled interrupts, or that the Flash ISR cannot run yet.
+ */
+static void ClearStats(const TFlashStatsType type)
+{
+  Stats[type].count = 0;
+  Stats[type].min = 0xFFFFFFFF;
+  Stats[type].max = 0;
+  Stats[type].total = 0;
+  for (uint8_t i = 0; i < FLASH_HISTOGRAM_SIZE; i++)
+    Stats[type].histogram[i] = 0;
+}
 
 /*!
 ** @}
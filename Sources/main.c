@@ -35,6 +35,7 @@
 #include "IO_Map.h"
 // CPU module - contains low level hardware initialization routines
 #include "Cpu.h"
+#include "DWT.h"
 #include "Events.h"
 //packet module - contains all the public functions to be used in this module
 #include "packet.h"
@@ -42,12 +43,18 @@
 #include "UART.h"
 //Flash module - contains all the public functions to be used in this module
 #include "Flash.h"
+#include "EEPROM.h"
+#include "Config.h"
+#include "Logger.h"
+#include "Update.h"
 //LED module - contains all the public functions to be used in this module
 #include "LEDs.h"
 #include "RTC.h"
 #include "PIT.h"
 #include "FTM.h"
 #include "analog.h"
+#include "DAC.h"
+#include "Monitor.h"
 #include "OS.h"
 #include "ThreadManage.h"
 
@@ -62,13 +69,58 @@
 #define PACKET_SET_TIME 0x0C
 #define PACKET_PROTOCOL_MODE 0x0A
 #define PACKET_ANALOG_INPUT_VALUE 0x50
+#define PACKET_ANALOG_ACQUIRE 0x51
+#define PACKET_ANALOG_DECIMATION 0x52
+#define PACKET_DAC_VALUE 0x53
+#define PACKET_WAVE_SHAPE 0x54
+#define PACKET_WAVE_SAMPLE 0x55
+#define PACKET_WAVE_PLAY 0x56
+#define PACKET_ANALOG_WINDOW 0x57
+#define PACKET_ANALOG_OVERSAMPLING 0x58
+#define PACKET_MONITOR_SETTING 0x59
+#define PACKET_MONITOR_EVENT 0x5A
+#define PACKET_LOG_MODE 0x60
+#define PACKET_LOG_EXTENT 0x61
+#define PACKET_LOG_UPLOAD 0x62
+#define PACKET_LOG_TIME 0x63
+#define PACKET_LOG_SAMPLE 0x64
+#define PACKET_LOG_FIND 0x65
+#define PACKET_FLASH_STATS 0x66
+#define PACKET_FLASH_BENCHMARK 0x67
+#define PACKET_FLASH_VERIFY 0x68
+#define PACKET_BOOT_TIME 0x69
+#define PACKET_SET_DATE 0x6A
+#define PACKET_SYNC_REQUEST 0x6B
+#define PACKET_SYNC_TIME 0x6C
+#define PACKET_SYNC_DRIFT 0x6D
+#define PACKET_LOG_FRACTION 0x6E
+#define PACKET_BOOT_COUNT 0x6F
+#define PACKET_UPDATE_BEGIN 0x70
+#define PACKET_UPDATE_CHUNK 0x71
+#define PACKET_UPDATE_DATA 0x72
+#define PACKET_UPDATE_END_CHUNK 0x73
+#define PACKET_UPDATE_CRC 0x74
+#define PACKET_UPDATE_COMMIT 0x75
+
+//parameter 1 of a monitor setting packet holds the channel in the high nibble and the setting in the low nibble,
+//and asks for the setting without changing it when the top bit is set
+#define MONITOR_QUERY_MASK 0x80
+
+//where firmware that predates the configuration records kept the tower number and mode
+#define LEGACY_DATA_START 0x00080000LU
 
 
 //global private constant to store the baudRate
 static const uint32_t BaudRate = 115200;
-//Private global variable to store the tower number
-volatile uint16union_t *NvTowerNb;
-volatile uint16union_t *NvTowerMd;
+//tower number and mode, saved in Flash as a configuration record
+typedef struct
+{
+  uint16union_t towerNumber;
+  uint16union_t towerMode;
+} TTowerConfig;
+
+//Private global variable to store the tower number and mode
+static TTowerConfig TowerConfig;
 //Private global constants to store the major and minor tower version
 static const uint8_t MajorTowerVersion = 0x01;
 static const uint8_t MinorTowerVersion = 0x00;
@@ -80,11 +132,21 @@ static bool synchronous = FALSE;
 static const uint8_t ADCChannel = 0;
 //RTC Time
 static uint8_t hours = 0, minutes = 0, seconds = 0;
+//CRC-32 of the firmware image being received
+static uint32union_t UpdateCRC;
+//RTC time being searched for by "Log - Find", sent in two halves
+static uint32union_t LogFindTime;
+//core clock cycles from the end of the low level initialization until the startup packets were sent
+static uint32_t BootCycles;
+//number of times the tower has started, kept in the emulated EEPROM as it changes at every boot
+static volatile uint32_t* BootCount;
 //PacketThread and InitThread stack
 OS_THREAD_STACK(PacketStack, THREAD_STACK_SIZE);
 OS_THREAD_STACK(InitStack, THREAD_STACK_SIZE);
 
 
+static void AcquireCallback(const TAnalogBlock* const block, void* arg);
+
 
 /*! @brief Handles the "Program" request packet
  *
@@ -125,6 +187,20 @@ static bool HandleReadPacket(void)
   return FALSE;
 }
 
+/*! @brief Saves a new tower configuration and makes it current
+ *
+ *  @param config - The new tower number and mode
+ *  @return bool - TRUE if the configuration was saved to the flash successfully
+ */
+static bool SaveTowerConfig(const TTowerConfig* const config)
+{
+  if (!Config_Save(config, sizeof(*config)))
+    return FALSE;
+
+  TowerConfig = *config;
+  return TRUE;
+}
+
 /*! @brief Handles the "Version number" request packet
  *
  *  @param specialPacket - Identifies if the program is currently in a startUp state
@@ -150,9 +226,13 @@ static bool HandleNumberPacket(bool specialPacket)
   if ((Packet_Parameter1 > 0x00 && Packet_Parameter1 < 0x03) || specialPacket == TRUE)
     {
       if (Packet_Parameter1 == 0x02)
-	return Flash_Write16((uint16_t*)NvTowerNb, Packet_Parameter23);
+	{
+	  TTowerConfig newConfig = TowerConfig;
+	  newConfig.towerNumber.l = Packet_Parameter23;
+	  return SaveTowerConfig(&newConfig);
+	}
       else if (!(Packet_Parameter2 || Packet_Parameter3))
-	return Packet_Put(PACKET_NUMBER, 0x01, (*NvTowerNb).s.Lo, (*NvTowerNb).s.Hi);
+	return Packet_Put(PACKET_NUMBER, 0x01, TowerConfig.towerNumber.s.Lo, TowerConfig.towerNumber.s.Hi);
     }
   return FALSE;
 }
@@ -168,9 +248,13 @@ static bool HandleModePacket(bool specialPacket)
   if ((Packet_Parameter1 > 0x00 && Packet_Parameter1 < 0x03) || specialPacket == TRUE)
     {
       if (Packet_Parameter1 == 0x02)
-        return Flash_Write16((uint16_t*)NvTowerMd, Packet_Parameter23);
+	{
+	  TTowerConfig newConfig = TowerConfig;
+	  newConfig.towerMode.l = Packet_Parameter23;
+	  return SaveTowerConfig(&newConfig);
+	}
       else if (!(Packet_Parameter2 || Packet_Parameter3))
-	return Packet_Put(PACKET_TOWER_MODE, 0x01, (*NvTowerMd).s.Lo, (*NvTowerMd).s.Hi);
+	return Packet_Put(PACKET_TOWER_MODE, 0x01, TowerConfig.towerMode.s.Lo, TowerConfig.towerMode.s.Hi);
     }
 
   return FALSE;
@@ -189,6 +273,68 @@ static bool HandleTimePacket(void)
   return FALSE;
 }
 
+/*! @brief Handles the "Set Date" request packet
+ *
+ *  Parameter 1 is the day of the month, parameter 2 the month and parameter 3 the year from 2000. The time of day is not changed.
+ *  @param None.
+ *  @return bool - TRUE if the date is valid and was set
+ */
+static bool HandleDatePacket(void)
+{
+  return RTC_SetDate(2000 + Packet_Parameter3, Packet_Parameter2, Packet_Parameter1);
+}
+
+/*! @brief Handles the "Clock Sync - Request" packet
+ *
+ *  Starts a clock sync. The reply holds the low 24 bits of the tower time in 1/32768 s, and the PC answers it
+ *  with a "Clock Sync - Time" packet as soon as it is received.
+ *  @param None.
+ *  @return bool - TRUE if the parameters were correct and the reply was sent to PC
+ */
+static bool HandleSyncRequestPacket(void)
+{
+  uint32_t time;
+
+  if (Packet_Parameter1 || Packet_Parameter2 || Packet_Parameter3)
+    return FALSE;
+
+  time = RTC_SyncStart();
+  return Packet_Put(PACKET_SYNC_REQUEST, (uint8_t)time, (uint8_t)(time >> 8), (uint8_t)(time >> 16));
+}
+
+/*! @brief Handles the "Clock Sync - Time" packet
+ *
+ *  Parameters 1 to 3 are the low 24 bits of the PC time in 1/32768 s, read when the "Clock Sync - Request" reply arrived.
+ *  The reply holds how far the tower clock was behind the PC, as a signed 24-bit number in 1/32768 s.
+ *  @param None.
+ *  @return bool - TRUE if the tower clock was synchronized and the offset was sent to PC
+ */
+static bool HandleSyncTimePacket(void)
+{
+  int32_t offset;
+
+  if (!RTC_SyncFinish(Packet_Parameter1 | (Packet_Parameter2 << 8) | ((uint32_t)Packet_Parameter3 << 16), &offset))
+    return FALSE;
+
+  return Packet_Put(PACKET_SYNC_TIME, (uint8_t)offset, (uint8_t)(offset >> 8), (uint8_t)(offset >> 16));
+}
+
+/*! @brief Handles the "Clock Sync - Drift" request packet
+ *
+ *  The reply holds the drift of the tower oscillator that is being compensated, as a signed 24-bit number in parts per billion.
+ *  @param None.
+ *  @return bool - TRUE if the parameters were correct and the drift was sent to PC
+ */
+static bool HandleSyncDriftPacket(void)
+{
+  int32_t drift = RTC_GetDrift();
+
+  if (Packet_Parameter1 || Packet_Parameter2 || Packet_Parameter3)
+    return FALSE;
+
+  return Packet_Put(PACKET_SYNC_DRIFT, (uint8_t)drift, (uint8_t)(drift >> 8), (uint8_t)(drift >> 16));
+}
+
 /*! @brief Handles the "Protocol - Mode" request packet
  *
  *  @param specialPacket - Identifies if the program is currently in a startUp state
@@ -219,6 +365,549 @@ static bool HandleProtocolPacket(bool specialPacket)
 }
 
 
+/*! @brief Handles the "Log - Mode" request packet
+ *
+ *  The reply holds the logging mode in parameter 2 and the number of samples lost, up to 255, in parameter 3.
+ *  @param None.
+ *  @return bool - TRUE if the parameters were correct and the logging mode was sent to PC
+ */
+static bool HandleLogModePacket(void)
+{
+  uint32_t lost;
+
+  //checks if this is a 'set' command to start or stop logging
+  if (Packet_Parameter1 == 0x02 && Packet_Parameter2 <= 1 && Packet_Parameter3 == 0)
+    Logger_Enable(Packet_Parameter2);
+  else if (Packet_Parameter1 != 0x01 || Packet_Parameter2 || Packet_Parameter3)
+    return FALSE;
+
+  lost = Logger_Lost();
+  return Packet_Put(PACKET_LOG_MODE, 0x01, (uint8_t)Logger_IsEnabled(), (lost > 0xFF) ? 0xFF : (uint8_t)lost);
+}
+
+/*! @brief Handles the "Log - Extent" request packet
+ *
+ *  @param None.
+ *  @return bool - TRUE if the number of logged records was sent to PC
+ */
+static bool HandleLogExtentPacket(void)
+{
+  uint16union_t count;
+
+  if (Packet_Parameter1 || Packet_Parameter2 || Packet_Parameter3)
+    return FALSE;
+
+  count.l = (uint16_t)Logger_Count();
+  return Packet_Put(PACKET_LOG_EXTENT, 0x00, count.s.Lo, count.s.Hi);
+}
+
+/*! @brief Handles the "Log - Upload" request packet
+ *
+ *  Parameter 1 is the number of records to send and parameters 2 and 3 the index of the first, where 0 is the oldest.
+ *  Each record is sent as a "Log - Sample" packet, preceded by a "Log - Time" packet with bits 0-23 of the RTC seconds
+ *  whenever the second changes, and a "Log - Fraction" packet whenever the time changes. The fraction packet holds
+ *  bits 24-31 of the seconds in parameter 1 and the fraction of the second, in units of 1/4096 s, in parameters 2 and 3.
+ *  @param None.
+ *  @return bool - TRUE if all the requested records were sent to PC
+ */
+static bool HandleLogUploadPacket(void)
+{
+  TLogRecord record;
+  uint32_t lastSeconds = 0;
+  uint16_t lastFraction = 0;
+  uint16_t index = Packet_Parameter23;
+  uint8_t count = Packet_Parameter1;
+  int16union_t value;
+  uint16union_t fraction;
+
+  for (uint8_t i = 0; i < count; i++)
+    {
+      if (!Logger_Get(index + i, &record))
+	return FALSE;
+
+      //the channel is in the low 4 bits of the fraction, so samples taken together share one fraction packet
+      fraction.l = record.fraction >> 4;
+
+      if (i == 0 || record.seconds != lastSeconds)
+	{
+	  if (!Packet_Put(PACKET_LOG_TIME, (uint8_t)record.seconds, (uint8_t)(record.seconds >> 8), (uint8_t)(record.seconds >> 16)))
+	    return FALSE;
+	}
+
+      if (i == 0 || record.seconds != lastSeconds || fraction.l != lastFraction)
+	{
+	  if (!Packet_Put(PACKET_LOG_FRACTION, (uint8_t)(record.seconds >> 24), fraction.s.Lo, fraction.s.Hi))
+	    return FALSE;
+	  lastFraction = fraction.l;
+	}
+      lastSeconds = record.seconds;
+
+      value.l = record.value;
+      if (!Packet_Put(PACKET_LOG_SAMPLE, record.fraction & 0x0F, value.s.Lo, value.s.Hi))
+	return FALSE;
+    }
+
+  return TRUE;
+}
+
+/*! @brief Handles the "Log - Find" request packet
+ *
+ *  The 32-bit RTC time is sent in two packets: parameter 1 selects the low (0) or high (1) half, and parameters 2 and 3 hold it.
+ *  The high half is sent last and starts the search. The reply holds the index of the first record
+ *  taken at or after that time, for use with "Log - Upload".
+ *  @param None.
+ *  @return bool - TRUE if the parameters were correct, and the index was sent to PC once the whole time had arrived
+ */
+static bool HandleLogFindPacket(void)
+{
+  uint32_t index;
+  uint16union_t position;
+
+  if (Packet_Parameter1 == 0x00)
+    {
+      LogFindTime.s.Lo = Packet_Parameter23;
+      return TRUE;
+    }
+  if (Packet_Parameter1 != 0x01)
+    return FALSE;
+
+  LogFindTime.s.Hi = Packet_Parameter23;
+
+  (void)Logger_Find(LogFindTime.l, &index);
+  position.l = (uint16_t)index;
+  return Packet_Put(PACKET_LOG_FIND, 0x00, position.s.Lo, position.s.Hi);
+}
+
+/*! @brief Handles the "Flash - Statistics" request packet
+ *
+ *  Parameter 1 selects the operation (see TFlashStatsType) and parameter 2 the statistic:
+ *  0 - count, 1 - min, 2 - max, 3 - mean, or 0x10 + n for histogram bin n.
+ *  The reply holds the 24-bit value, in microseconds for the latencies. If parameter 3 is 1 the statistics are cleared instead.
+ *  @param None.
+ *  @return bool - TRUE if the parameters were correct and the statistic was sent to PC
+ */
+static bool HandleFlashStatsPacket(void)
+{
+  TFlashStats stats;
+  uint32_t value;
+
+  if (Packet_Parameter3 == 0x01)
+    return Flash_ResetStats((TFlashStatsType)Packet_Parameter1);
+  if (Packet_Parameter3 || !Flash_GetStats((TFlashStatsType)Packet_Parameter1, &stats))
+    return FALSE;
+
+  switch (Packet_Parameter2)
+  {
+    case 0x00:
+      value = stats.count;
+      break;
+    case 0x01:
+      value = stats.count ? stats.min : 0;
+      break;
+    case 0x02:
+      value = stats.max;
+      break;
+    case 0x03:
+      value = stats.count ? (uint32_t)(stats.total / stats.count) : 0;
+      break;
+    default:
+      if (Packet_Parameter2 < 0x10 || Packet_Parameter2 >= 0x10 + FLASH_HISTOGRAM_SIZE)
+	return FALSE;
+      value = stats.histogram[Packet_Parameter2 - 0x10];
+      break;
+  }
+
+  //saturate to what fits in the packet
+  if (value > 0xFFFFFF)
+    value = 0xFFFFFF;
+
+  return Packet_Put(PACKET_FLASH_STATS, (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16));
+}
+
+/*! @brief Handles the "Flash - Benchmark" request packet
+ *
+ *  Parameter 1 is the number of erase/program cycles to run on the scratch sector and parameter 2 selects
+ *  programming with Program Section (1) or one phrase at a time (0). The reply holds the mean time of a cycle in milliseconds.
+ *  @param None.
+ *  @return bool - TRUE if the benchmark completed and the result was sent to PC
+ */
+static bool HandleFlashBenchmarkPacket(void)
+{
+  uint32_t microseconds;
+  uint16union_t milliseconds;
+
+  if (Packet_Parameter1 == 0 || Packet_Parameter2 > 1 || Packet_Parameter3)
+    return FALSE;
+
+  if (!Flash_Benchmark(Packet_Parameter1, Packet_Parameter2, &microseconds))
+    return FALSE;
+
+  milliseconds.l = (uint16_t)((microseconds + 500) / 1000);
+  return Packet_Put(PACKET_FLASH_BENCHMARK, Packet_Parameter2, milliseconds.s.Lo, milliseconds.s.Hi);
+}
+
+/*! @brief Handles the "Flash - Verify" request packet
+ *
+ *  Parameter 1 is 1 to get or 2 to set whether Flash erases and writes are verified, and parameter 2 is the new setting.
+ *  @param None.
+ *  @return bool - TRUE if the parameters were correct and the verify setting was sent to PC
+ */
+static bool HandleFlashVerifyPacket(void)
+{
+  //checks if this is a 'set' command to turn verification on or off
+  if (Packet_Parameter1 == 0x02 && Packet_Parameter2 <= 1 && Packet_Parameter3 == 0)
+    Flash_SetVerify(Packet_Parameter2);
+  else if (Packet_Parameter1 != 0x01 || Packet_Parameter2 || Packet_Parameter3)
+    return FALSE;
+
+  return Packet_Put(PACKET_FLASH_VERIFY, 0x01, (uint8_t)Flash_IsVerifying(), 0x00);
+}
+
+/*! @brief Handles the "Analog - Acquire" request packet
+ *
+ *  Parameter 1 is 1 to start the acquisition engine or 0 to stop it, and parameters 2 and 3 are the base rate in Hz,
+ *  which each channel's decimation divides. A running engine changes to the new rate without losing its block.
+ *  While the engine runs, the values are reported once per block instead of by the PIT.
+ *  @param None.
+ *  @return bool - TRUE if the acquisition engine was started, changed or stopped
+ */
+static bool HandleAcquirePacket(void)
+{
+  uint16union_t rate;
+
+  if (Packet_Parameter1 == 0x00 && Packet_Parameter2 == 0 && Packet_Parameter3 == 0)
+    {
+      Analog_Stop();
+      return TRUE;
+    }
+
+  if (Packet_Parameter1 != 0x01)
+    return FALSE;
+
+  rate.s.Lo = Packet_Parameter2;
+  rate.s.Hi = Packet_Parameter3;
+
+  if (rate.l == 0)
+    return FALSE;
+
+  if (Analog_IsAcquiring())
+    return Analog_SetPeriod(1000000000 / rate.l);
+
+  return Analog_Start(1000000000 / rate.l, AcquireCallback, NULL);
+}
+
+/*! @brief Handles the "Analog - Decimation" request packet
+ *
+ *  Parameter 1 is the analog input and parameter 2 is how many periods of the base rate there are between its samples,
+ *  a power of 2, or 0 to stop sampling it. The decimation is sent back, which is all a request with parameter 2 and 3 of 0xFF does.
+ *  @param None.
+ *  @return bool - TRUE if the decimation was set and sent back
+ */
+static bool HandleDecimationPacket(void)
+{
+  if (Packet_Parameter1 >= ANALOG_NB_INPUTS)
+    return FALSE;
+
+  if (!(Packet_Parameter2 == 0xFF && Packet_Parameter3 == 0xFF))
+    if (Packet_Parameter3 || !Analog_SetDecimation(Packet_Parameter1, Packet_Parameter2))
+      return FALSE;
+
+  return Packet_Put(PACKET_ANALOG_DECIMATION, Packet_Parameter1, Analog_GetDecimation(Packet_Parameter1), 0x00);
+}
+
+/*! @brief Handles the "Analog - Window" request packet
+ *
+ *  Parameter 1 is the analog input and parameter 2 is the number of samples in its median filter window.
+ *  The window size is sent back, which is all a request with parameter 2 and 3 of 0xFF does.
+ *  @param None.
+ *  @return bool - TRUE if the window size was set and sent back
+ */
+static bool HandleWindowPacket(void)
+{
+  if (Packet_Parameter1 >= ANALOG_NB_INPUTS)
+    return FALSE;
+
+  if (!(Packet_Parameter2 == 0xFF && Packet_Parameter3 == 0xFF))
+    if (Packet_Parameter3 || !Analog_SetWindow(Packet_Parameter1, Packet_Parameter2))
+      return FALSE;
+
+  return Packet_Put(PACKET_ANALOG_WINDOW, Packet_Parameter1, Analog_Input[Packet_Parameter1].windowSize, 0x00);
+}
+
+/*! @brief Handles the "Analog - Oversampling" request packet
+ *
+ *  Parameter 1 is the analog input, parameter 2 is the number of samples averaged into each value, a power of 2 or 1 for none,
+ *  and parameter 3 is the order of the filter. The oversampling is sent back, which is all a request with parameter 2 and 3 of 0xFF does.
+ *  @param None.
+ *  @return bool - TRUE if the oversampling was set and sent back
+ */
+static bool HandleOversamplingPacket(void)
+{
+  uint8_t ratio, order;
+
+  if (Packet_Parameter1 >= ANALOG_NB_INPUTS)
+    return FALSE;
+
+  if (!(Packet_Parameter2 == 0xFF && Packet_Parameter3 == 0xFF))
+    if (!Analog_SetOversampling(Packet_Parameter1, Packet_Parameter2, Packet_Parameter3))
+      return FALSE;
+
+  Analog_GetOversampling(Packet_Parameter1, &ratio, &order);
+  return Packet_Put(PACKET_ANALOG_OVERSAMPLING, Packet_Parameter1, ratio, order);
+}
+
+/*! @brief Handles the "Monitor - Setting" request packet
+ *
+ *  Parameter 1 is the analog input in the high nibble and the setting in the low nibble, and parameters 2 and 3 are the value of the setting.
+ *  The settings are enable, deadband, low limit, high limit, hysteresis and rate, in that order.
+ *  The setting is sent back, which is all a request with the top bit of parameter 1 set does.
+ *  @param None.
+ *  @return bool - TRUE if the setting was changed and sent back
+ */
+static bool HandleMonitorPacket(void)
+{
+  uint8_t channelNb = (Packet_Parameter1 & ~MONITOR_QUERY_MASK) >> 4;
+  TMonitorSetting setting = (TMonitorSetting)(Packet_Parameter1 & 0x0F);
+  int16union_t value;
+
+  if (channelNb >= ANALOG_NB_INPUTS || setting >= MONITOR_NB_SETTINGS)
+    return FALSE;
+
+  if (!(Packet_Parameter1 & MONITOR_QUERY_MASK))
+    {
+      value.s.Lo = Packet_Parameter2;
+      value.s.Hi = Packet_Parameter3;
+
+      if (!Monitor_Set(channelNb, setting, value.l))
+	return FALSE;
+    }
+
+  value.l = Monitor_Get(channelNb, setting);
+  return Packet_Put(PACKET_MONITOR_SETTING, Packet_Parameter1 & ~MONITOR_QUERY_MASK, value.s.Lo, value.s.Hi);
+}
+
+/*! @brief Handles the "DAC - Value" request packet
+ *
+ *  Parameter 1 is the DAC output, and parameters 2 and 3 are the value to set it to.
+ *  @param None.
+ *  @return bool - TRUE if the value was written
+ */
+static bool HandleDACValuePacket(void)
+{
+  int16union_t value;
+
+  value.s.Lo = Packet_Parameter2;
+  value.s.Hi = Packet_Parameter3;
+
+  return DAC_Put(Packet_Parameter1, value.l);
+}
+
+/*! @brief Handles the "Wave - Shape" request packet
+ *
+ *  Parameter 1 is the shape, 0 for sine, 1 for square, 2 for triangle or 3 for sawtooth,
+ *  and parameters 2 and 3 are the number of samples in a cycle.
+ *  @param None.
+ *  @return bool - TRUE if the waveform was built
+ */
+static bool HandleWaveShapePacket(void)
+{
+  uint16union_t length;
+
+  length.s.Lo = Packet_Parameter2;
+  length.s.Hi = Packet_Parameter3;
+
+  return DAC_SetShape((TDACWaveShape)Packet_Parameter1, length.l);
+}
+
+/*! @brief Handles the "Wave - Sample" request packet
+ *
+ *  Parameter 1 is the position of the sample in the cycle, and parameters 2 and 3 are its value.
+ *  The samples are sent in order, and sample 0 starts a new waveform.
+ *  @param None.
+ *  @return bool - TRUE if the sample was loaded
+ */
+static bool HandleWaveSamplePacket(void)
+{
+  int16union_t value;
+
+  value.s.Lo = Packet_Parameter2;
+  value.s.Hi = Packet_Parameter3;
+
+  return DAC_SetSample(Packet_Parameter1, value.l);
+}
+
+/*! @brief Handles the "Wave - Play" request packet
+ *
+ *  Parameter 1 is the DAC output, and parameters 2 and 3 are the sample rate in Hz, or 0 to stop the waveform.
+ *  @param None.
+ *  @return bool - TRUE if the waveform was started or stopped
+ */
+static bool HandleWavePlayPacket(void)
+{
+  uint16union_t rate;
+
+  rate.s.Lo = Packet_Parameter2;
+  rate.s.Hi = Packet_Parameter3;
+
+  if (rate.l == 0)
+    {
+      DAC_Stop();
+      return TRUE;
+    }
+
+  return DAC_Play(Packet_Parameter1, 1000000000 / rate.l);
+}
+
+/*! @brief Handles the "Boot Time" request packet
+ *
+ *  The reply holds the time from the end of the low level initialization until the startup packets were sent, in microseconds.
+ *  @param None.
+ *  @return bool - TRUE if the parameters were correct and the boot time was sent to PC
+ */
+static bool HandleBootTimePacket(void)
+{
+  uint32_t microseconds = BootCycles / CYCLES_PER_US;
+
+  if (Packet_Parameter1 || Packet_Parameter2 || Packet_Parameter3)
+    return FALSE;
+
+  //saturate to what fits in the packet
+  if (microseconds > 0xFFFFFF)
+    microseconds = 0xFFFFFF;
+
+  return Packet_Put(PACKET_BOOT_TIME, (uint8_t)microseconds, (uint8_t)(microseconds >> 8), (uint8_t)(microseconds >> 16));
+}
+
+/*! @brief Handles the "Boot Count" request packet
+ *
+ *  The reply holds the low 24 bits of the number of times the tower has started.
+ *  @param None.
+ *  @return bool - TRUE if the parameters were correct and the boot count was sent to PC
+ */
+static bool HandleBootCountPacket(void)
+{
+  uint32_t count;
+
+  if (Packet_Parameter1 || Packet_Parameter2 || Packet_Parameter3 || !BootCount)
+    return FALSE;
+
+  count = *BootCount;
+  return Packet_Put(PACKET_BOOT_COUNT, (uint8_t)count, (uint8_t)(count >> 8), (uint8_t)(count >> 16));
+}
+
+/*! @brief Counts this start of the tower in the emulated EEPROM
+ *
+ *  @param void
+ *  @return void
+ */
+static void BootCountInit(void)
+{
+  volatile uint32_t* count;
+
+  if (!EEPROM_AllocateVar((volatile void**)&count, sizeof(*count)))
+    return;
+
+  //an erased count has never been written
+  if (EEPROM_Write32(count, (*count == 0xFFFFFFFF) ? 1 : *count + 1))
+    BootCount = count;
+}
+
+/*! @brief Handles the "Update - Begin" request packet
+ *
+ *  Parameters 1 to 3 are the length of the new firmware image in bytes.
+ *  @param None.
+ *  @return bool - TRUE if the update was started
+ */
+static bool HandleUpdateBeginPacket(void)
+{
+  return Update_Begin(Packet_Parameter1 | (Packet_Parameter2 << 8) | ((uint32_t)Packet_Parameter3 << 16));
+}
+
+/*! @brief Handles the "Update - Chunk" request packet
+ *
+ *  Parameters 2 and 3 are the number of the chunk. The chunk data follows in "Update - Data" packets,
+ *  which are not acknowledged so the image can be sent at the full speed of the link.
+ *  @param None.
+ *  @return bool - TRUE if an update is in progress
+ */
+static bool HandleUpdateChunkPacket(void)
+{
+  if (Packet_Parameter1)
+    return FALSE;
+
+  return Update_StartChunk(Packet_Parameter23);
+}
+
+/*! @brief Handles the "Update - Data" request packet
+ *
+ *  @param None.
+ *  @return bool - TRUE if the 3 bytes of data fit in the chunk
+ */
+static bool HandleUpdateDataPacket(void)
+{
+  uint8_t data[3] = {Packet_Parameter1, Packet_Parameter2, Packet_Parameter3};
+
+  return Update_Data(data, sizeof(data));
+}
+
+/*! @brief Handles the "Update - End Chunk" request packet
+ *
+ *  Parameters 1 to 3 are the low 24 bits of the CRC-32 of the chunk. The reply holds the outcome (see TUpdateStatus)
+ *  and the number of the next chunk expected, which the PC sends next.
+ *  @param None.
+ *  @return bool - TRUE if the reply was sent to PC
+ */
+static bool HandleUpdateEndChunkPacket(void)
+{
+  TUpdateStatus status = Update_EndChunk(Packet_Parameter1 | (Packet_Parameter2 << 8) | ((uint32_t)Packet_Parameter3 << 16));
+  uint16union_t chunkNb;
+
+  chunkNb.l = Update_NextChunk();
+  return Packet_Put(PACKET_UPDATE_END_CHUNK, (uint8_t)status, chunkNb.s.Lo, chunkNb.s.Hi);
+}
+
+/*! @brief Handles the "Update - CRC" request packet
+ *
+ *  Parameter 1 selects the low (0) or high (1) half of the CRC-32 of the whole image, and parameters 2 and 3 hold it.
+ *  @param None.
+ *  @return bool - TRUE if the parameters were correct
+ */
+static bool HandleUpdateCRCPacket(void)
+{
+  if (Packet_Parameter1 == 0x00)
+    UpdateCRC.s.Lo = Packet_Parameter23;
+  else if (Packet_Parameter1 == 0x01)
+    UpdateCRC.s.Hi = Packet_Parameter23;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+/*! @brief Handles the "Update - Commit" request packet
+ *
+ *  Checks the image against the CRC sent in "Update - CRC" packets and sets the Flash to swap halves.
+ *  The reply holds the outcome (see TUpdateStatus), and the tower then resets into the new firmware.
+ *  @param None.
+ *  @return bool - TRUE if the image was committed
+ */
+static bool HandleUpdateCommitPacket(void)
+{
+  TUpdateStatus status;
+
+  if (Packet_Parameter1 || Packet_Parameter2 || Packet_Parameter3)
+    return FALSE;
+
+  status = Update_Commit(UpdateCRC.l);
+  (void)Packet_Put(PACKET_UPDATE_COMMIT, (uint8_t)status, 0x00, 0x00);
+
+  //data stored from now on would not be carried over, so swap straight away
+  if (status == UPDATE_OK)
+    Update_Reboot();
+
+  return FALSE;
+}
+
 /*! @brief Handles the "Special" request packet
  *
  *  @param None.
@@ -290,9 +979,121 @@ static void HandlePacket(void)
 	success = HandleTimePacket();
     break;
 
+    case (PACKET_SET_DATE):
+	success = HandleDatePacket();
+    break;
+
+    case (PACKET_SYNC_REQUEST):
+	success = HandleSyncRequestPacket();
+    break;
+
+    case (PACKET_SYNC_TIME):
+	success = HandleSyncTimePacket();
+    break;
+
+    case (PACKET_SYNC_DRIFT):
+	success = HandleSyncDriftPacket();
+    break;
+
     case (PACKET_PROTOCOL_MODE):
 	success = HandleProtocolPacket(FALSE);
     break;
+
+    case (PACKET_LOG_MODE):
+	success = HandleLogModePacket();
+    break;
+
+    case (PACKET_LOG_EXTENT):
+	success = HandleLogExtentPacket();
+    break;
+
+    case (PACKET_LOG_UPLOAD):
+	success = HandleLogUploadPacket();
+    break;
+
+    case (PACKET_LOG_FIND):
+	success = HandleLogFindPacket();
+    break;
+
+    case (PACKET_FLASH_STATS):
+	success = HandleFlashStatsPacket();
+    break;
+
+    case (PACKET_FLASH_BENCHMARK):
+	success = HandleFlashBenchmarkPacket();
+    break;
+
+    case (PACKET_FLASH_VERIFY):
+	success = HandleFlashVerifyPacket();
+    break;
+
+    case (PACKET_ANALOG_ACQUIRE):
+	success = HandleAcquirePacket();
+    break;
+
+    case (PACKET_ANALOG_DECIMATION):
+	success = HandleDecimationPacket();
+    break;
+
+    case (PACKET_ANALOG_WINDOW):
+	success = HandleWindowPacket();
+    break;
+
+    case (PACKET_ANALOG_OVERSAMPLING):
+	success = HandleOversamplingPacket();
+    break;
+
+    case (PACKET_MONITOR_SETTING):
+	success = HandleMonitorPacket();
+    break;
+
+    case (PACKET_DAC_VALUE):
+	success = HandleDACValuePacket();
+    break;
+
+    case (PACKET_WAVE_SHAPE):
+	success = HandleWaveShapePacket();
+    break;
+
+    case (PACKET_WAVE_SAMPLE):
+	success = HandleWaveSamplePacket();
+    break;
+
+    case (PACKET_WAVE_PLAY):
+	success = HandleWavePlayPacket();
+    break;
+
+    case (PACKET_BOOT_TIME):
+	success = HandleBootTimePacket();
+    break;
+
+    case (PACKET_BOOT_COUNT):
+	success = HandleBootCountPacket();
+    break;
+
+    case (PACKET_UPDATE_BEGIN):
+	success = HandleUpdateBeginPacket();
+    break;
+
+    case (PACKET_UPDATE_CHUNK):
+	success = HandleUpdateChunkPacket();
+    break;
+
+    case (PACKET_UPDATE_DATA):
+	success = HandleUpdateDataPacket();
+    break;
+
+    case (PACKET_UPDATE_END_CHUNK):
+	success = HandleUpdateEndChunkPacket();
+    break;
+
+    case (PACKET_UPDATE_CRC):
+	success = HandleUpdateCRCPacket();
+    break;
+
+    case (PACKET_UPDATE_COMMIT):
+	success = HandleUpdateCommitPacket();
+    break;
   }
    if (Packet_Command & PACKET_ACK_MASK) //sends acknowledgment (if PC requested it) packet to PC
      {
@@ -306,7 +1107,7 @@ static void HandlePacket(void)
 
 
 
-/*! @brief Allocates space in the flash for Tower Number and Mode then writes data to the flash if required
+/*! @brief Restores the Tower Number and Mode from the flash, saving the defaults if there are none
  *
  *  @param void
  *  @return void
@@ -315,19 +1116,58 @@ static void TowerNumberModeInit(void)
 {
   uint16_t towerNumber = 6702;
   uint16_t towerMode = 1;
+  TFlashSwapMode mode;
 
-  if (Flash_AllocateVar((volatile void **)&NvTowerNb, sizeof(*NvTowerNb)) &&
-      Flash_AllocateVar((volatile void **)&NvTowerMd, sizeof(*NvTowerMd)))
+  if (!Config_Init(&TowerConfig, sizeof(TowerConfig)))
     {
-      if ((*NvTowerNb).l == 0xffff) //writes the tower number in the flash if nothing is there
-	Flash_Write16((uint16_t*)NvTowerNb, towerNumber);
-
-      if ((*NvTowerMd).l == 0xffff) //writes the tower mode in the flash if nothing is there
-	Flash_Write16((uint16_t*)NvTowerMd, towerMode);
+      //carry over the values from where older firmware kept them, unless an update has since put an image there
+      if (Flash_Swap(FLASH_SWAP_REPORT, &mode) && mode == FLASH_SWAP_UNINITIALIZED)
+	{
+	  if (_FH(LEGACY_DATA_START) != 0xffff)
+	    towerNumber = _FH(LEGACY_DATA_START);
+	  if (_FH(LEGACY_DATA_START + 2) != 0xffff)
+	    towerMode = _FH(LEGACY_DATA_START + 2);
+	}
+
+      TowerConfig.towerNumber.l = towerNumber;
+      TowerConfig.towerMode.l = towerMode;
+
+      (void)Config_Save(&TowerConfig, sizeof(TowerConfig));
     }
 }
 
 
+/*! @brief Logs and sends the latest value of the analog input
+ *
+ *  In asynchronous mode, a value is only sent when the monitor of its channel finds an event,
+ *  and events other than a change of value are sent as well.
+ *  @param void
+ *  @return void
+ */
+static void ReportSample(void)
+{
+  uint8_t events;
+
+  //records the sample in Flash if logging is enabled
+  (void)Logger_Append(ADCChannel, Analog_Input[ADCChannel].value.l);
+  //will behave differently if tower is in synchronous or asynchronous
+  if(synchronous)
+    {
+      Packet_Put(PACKET_ANALOG_INPUT_VALUE, 0x00, Analog_Input[ADCChannel].value.s.Lo, Analog_Input[ADCChannel].value.s.Hi);
+    }
+  else
+    {
+      for (uint8_t i = 0; i < ANALOG_NB_INPUTS; i++)
+	{
+	  events = Monitor_Check(i, Analog_Input[i].value.l);
+	  if (events)
+	    Packet_Put(PACKET_ANALOG_INPUT_VALUE, i, Analog_Input[i].value.s.Lo, Analog_Input[i].value.s.Hi);
+	  if (events & ~MONITOR_EVENT_CHANGE)
+	    Packet_Put(PACKET_MONITOR_EVENT, i, events, 0x00);
+	}
+    }
+}
+
 /*! @brief Call back functions for the PIT ISR
  *
  *  @param void
@@ -344,18 +1184,22 @@ static void PITCallback(void* arg)
       ledToggleCount = 0;
     }
 
-  //will behave differently if tower is in synchronous or asynchronous
-  Analog_Get(ADCChannel);
-  if(synchronous)
-    {
-      Packet_Put(PACKET_ANALOG_INPUT_VALUE, 0x00, Analog_Input[ADCChannel].value.s.Lo, Analog_Input[ADCChannel].value.s.Hi);
-    }
-  else
-    {
-      if (Analog_Input[ADCChannel].value.l != Analog_Input[ADCChannel].oldValue.l)
-	Packet_Put(PACKET_ANALOG_INPUT_VALUE, 0x00, Analog_Input[ADCChannel].value.s.Lo, Analog_Input[ADCChannel].value.s.Hi);
-    }
+  //the acquisition engine samples and reports on its own while it runs, and the ADC cannot be read while a waveform plays
+  if (Analog_IsAcquiring())
+    return;
+
+  if (Analog_Get(ADCChannel))
+    ReportSample();
+}
 
+/*! @brief Call back function for each block from the acquisition engine
+ *
+ *  @param block The block of samples, which have already been filtered into Analog_Input.
+ *  @param arg Not used.
+ */
+static void AcquireCallback(const TAnalogBlock* const block, void* arg)
+{
+  ReportSample();
 }
 
 
@@ -418,22 +1262,32 @@ static void InitThread(void* pData)
 
           LEDs_Init();
 
-          if (Packet_Init(BaudRate, CPU_BUS_CLK_HZ) && Flash_Init() && Analog_Init(CPU_BUS_CLK_HZ)
+          if (Packet_Init(BaudRate, CPU_BUS_CLK_HZ) && Flash_Init() && Analog_Init(CPU_BUS_CLK_HZ) && DAC_Init()
               &&  RTC_Init(RTCCallback, NULL) && PIT_Init(CPU_BUS_CLK_HZ, PITCallback, NULL) &&
               FTM_Init())
             LEDs_On(LED_ORANGE);
 
+          //in asynchronous mode the input that the PIT samples is reported on every change, until the PC sets up its monitor
+          Monitor_Init();
+          (void)Monitor_Set(ADCChannel, MONITOR_ENABLE, 1);
+
           //setup the PIT and call for Channel 0 to be set up
           PIT_Set(10000000, TRUE);
           CH01SecondTimerInit();
+          OS_EnableInterrupts(); //enable interrupts
 
-          //handles the initialization tower number and mode in the flash
+          //handles the initialization tower number and mode in the flash (Flash commands complete by interrupt)
           TowerNumberModeInit();
-          OS_EnableInterrupts(); //enable interrupts
+          EEPROM_Init();
+          Logger_Init();
 
           //sends the initial packets when the tower starts up
+          BootCycles = DWT_CYCCNT;
           HandleSpecialPacket(TRUE);
 
+          //counted once the first packets are out, so the Flash write does not hold them up
+          BootCountInit();
+
           OS_ThreadDelete(OS_PRIORITY_SELF);
     }
 
@@ -455,6 +1309,11 @@ int main(void)
   PE_low_level_init();
   /*** End of Processor Expert internal initialization.                    ***/
 
+  //start the cycle counter from zero to time the boot
+  DEMCR |= DEMCR_TRCENA_MASK;
+  DWT_CYCCNT = 0;
+  DWT_CTRL |= DWT_CTRL_CYCCNTENA_MASK;
+
   OS_Init(CPU_CORE_CLK_HZ, false);
 
   OS_ThreadCreate(InitThread, NULL, &InitStack[THREAD_STACK_SIZE - 1], INIT_THREAD);